@@ -1,6 +1,6 @@
 #include <App.hpp>
-#include <future>
 #include <Stats.hpp>
+#include <string>
 
 App::App(int argc, char *argv[])
 {
@@ -12,6 +12,12 @@ App::App(int argc, char *argv[])
     physicsIntegrator = std::make_shared<PhysicsIntegrator>();
     physicsIntegrator->scene = scene;
     physicsIntegrator->Initialize();
+    for (int i = 1; i < argc; i++) {
+        // Compares the batch kernel against per-rod stepping before the app starts
+        if (std::string(argv[i]) == "--check-batch-parity") {
+            physicsIntegrator->CheckBatchParity(100);
+        }
+    }
 
     gui.scene = scene;
     gui.physicsIntegrator = physicsIntegrator;
@@ -20,22 +26,16 @@ App::App(int argc, char *argv[])
 
 void App::Run(EventHandler &eventHandler)
 {
+    running = true;
+    physicsThread = std::thread(&App::PhysicsLoop, this);
+
     while (eventHandler.IsRunning()) {
         auto start = std::chrono::high_resolution_clock::now();
 
-        std::async(std::launch::async | std::launch::deferred, [&] {
-            auto startP = std::chrono::high_resolution_clock::now();
-
-            physicsIntegrator->Integrate();
-
-            auto endP = std::chrono::high_resolution_clock::now();
-
-            stats::lastPhysicsTime = std::chrono::duration_cast<std::chrono::milliseconds>(endP - startP).count() / 1000.0f;
-            stats::avgPhysicsTime = stats::avgPhysicsTime * 0.99f + stats::lastPhysicsTime * 0.01f; // rolling average
-        }); // Run the physics integrator in a separate thread
-
         eventHandler.SwapBuffers();
         eventHandler.DispatchEvents(renderer);
+        // Upload the hair as of now, between the last two ticks the physics thread published
+        renderer.PostPhysicsSync();
 
         auto startR = std::chrono::high_resolution_clock::now();
         renderer.Render();
@@ -50,6 +50,44 @@ void App::Run(EventHandler &eventHandler)
         gui.Draw();
     }
 
+    {
+        std::lock_guard<std::mutex> lock(stopMutex);
+        running = false;
+    }
+    stopRequested.notify_one();
+    physicsThread.join();
+
     // Clean up here
     gui.Terminate();
 }
+
+void App::PhysicsLoop()
+{
+    auto last = std::chrono::steady_clock::now();
+    while (true) {
+        auto startP = std::chrono::steady_clock::now();
+        const float elapsed = std::chrono::duration<float>(startP - last).count();
+        last = startP;
+        int ticks;
+        float timeToNextTick;
+        {
+            // The tick rate is set from the GUI under this lock, so read it here too
+            std::lock_guard<std::mutex> lock(scene->simulationMutex);
+            ticks = physicsIntegrator->Advance(elapsed, startP);
+            timeToNextTick = physicsIntegrator->getTimeToNextTick();
+        }
+        auto endP = std::chrono::steady_clock::now();
+
+        if (ticks > 0) {
+            stats::lastPhysicsTime = std::chrono::duration_cast<std::chrono::milliseconds>(endP - startP).count() / 1000.0f / ticks;
+            stats::avgPhysicsTime = stats::avgPhysicsTime * 0.99f + stats::lastPhysicsTime * 0.01f; // rolling average
+        }
+
+        // Physics faster than real time idles here until the next tick is due
+        const auto nextTick = startP + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<float>(timeToNextTick));
+        std::unique_lock<std::mutex> lock(stopMutex);
+        if (stopRequested.wait_until(lock, nextTick, [&] { return !running; }))
+            break;
+    }
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <Renderer.hpp>
 #include <GUIManager.hpp>
 #include <EventHandler.hpp>
@@ -13,8 +17,21 @@ public:
     // Runs the main event loop
     void Run(EventHandler &eventHandler);
 private:
+    /*
+    * Body of the physics thread. Advances the simulation by the wall time gone by at
+    * the integrator's fixed tick rate, whatever the frame rate, while the render
+    * thread draws from the ticks it published, and sleeps until the next tick is due.
+    */
+    void PhysicsLoop();
+
     Renderer renderer;
     GUIManager gui;
     std::shared_ptr<PhysicsIntegrator> physicsIntegrator;
     std::shared_ptr<Scene> scene;
-};
\ No newline at end of file
+
+    std::thread physicsThread;
+    // Guards running, stopRequested wakes the physics thread early from its sleep
+    std::mutex stopMutex;
+    std::condition_variable stopRequested;
+    bool running = false;
+};
@@ -221,10 +221,7 @@ void GUIManager::DrawSurfaceMeshControls()
 
         if (ImGui::CollapsingHeader("Transform##0"))
         {
-            ImGui::DragFloat3("Position##0", &scene->surface->position.x, 0.01f);
-            ImGui::DragFloat3("Rotation##0", &scene->surface->rotation.x, 0.01f);
-            ImGui::DragFloat3("Scale##0", &scene->surface->scale.x, 0.01f);
-            scene->surface->setTransform();
+            DrawTransformControls(*scene->surface, 0);
         }
     }
 }
@@ -233,10 +230,27 @@ void GUIManager::DrawColliderMeshControls()
 {
     if (ImGui::CollapsingHeader("Collider Transform"))
     {
-        ImGui::DragFloat3("Position##1", &scene->dummy->position.x, 0.01f);
-        ImGui::DragFloat3("Rotation##1", &scene->dummy->rotation.x, 0.01f);
-        ImGui::DragFloat3("Scale##1", &scene->dummy->scale.x, 0.01f);
-        scene->dummy->setTransform();
+        static int model = 0;
+        static const char* modelPaths[] = {"resources/sphere.obj", "resources/suzanne.obj", "resources/teapot.obj"};
+        if (ImGui::Combo("Mesh##1", &model, "Sphere\0Suzanne\0Teapot\0"))
+            scene->setDummyModel(modelPaths[model]);
+        DrawTransformControls(*scene->dummy, 1);
+    }
+}
+
+void GUIManager::DrawTransformControls(SceneObject& object, int id)
+{
+    ImGui::PushID(id);
+    glm::vec3 position = object.position, rotation = object.rotation, scale = object.scale;
+    bool changed = false;
+    changed |= ImGui::DragFloat3("Position", &position.x, 0.01f);
+    changed |= ImGui::DragFloat3("Rotation", &rotation.x, 0.01f);
+    // Kept above 0 so the transform stays invertible for the collider
+    changed |= ImGui::DragFloat3("Scale", &scale.x, 0.01f, 0.01f, 100.0f);
+    ImGui::PopID();
+    if (changed) {
+        std::lock_guard<std::mutex> lock(scene->simulationMutex);
+        object.setTransform(position, rotation, scale);
     }
 }
 
@@ -290,10 +304,62 @@ void GUIManager::DrawSimulationControls()
     {
         float dt = physicsIntegrator->getDt();
         if (ImGui::DragFloat("dt", &dt, 0.0001f, 0.0f, 0.1f, "%.5f"))
-            physicsIntegrator->setDt(dt);
+            changes.push_back([this, dt] { physicsIntegrator->setDt(dt); });
         int numSteps = physicsIntegrator->getNumSteps();
         if (ImGui::InputInt("numSteps", &numSteps, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue))
-            physicsIntegrator->setNumSteps(numSteps);
+            changes.push_back([this, numSteps] { physicsIntegrator->setNumSteps(numSteps); });
+        float tickRate = physicsIntegrator->getTickRate();
+        if (ImGui::DragFloat("physics rate (Hz)", &tickRate, 0.5f, 1.0f, 480.0f, "%.1f"))
+            changes.push_back([this, tickRate] { physicsIntegrator->setTickRate(tickRate); });
+        int maxCatchUp = physicsIntegrator->getMaxCatchUp();
+        if (ImGui::InputInt("max catch-up ticks", &maxCatchUp, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue))
+            changes.push_back([this, maxCatchUp] { physicsIntegrator->setMaxCatchUp(maxCatchUp); });
+        int integrator = (int)physicsIntegrator->getIntegrator();
+        if (ImGui::Combo("Integrator", &integrator, "Forward Euler\0Implicit Euler\0"))
+            changes.push_back([this, integrator] { physicsIntegrator->setIntegrator((PhysicsIntegrator::Integrator)integrator); });
+        int solver = (int)physicsIntegrator->getSolver();
+        if (ImGui::Combo("Solver", &solver, "DER\0XPBD + FTL\0"))
+            changes.push_back([this, solver] { physicsIntegrator->setSolver((PhysicsIntegrator::Solver)solver); });
+        bool adaptiveSteps = physicsIntegrator->getAdaptiveSteps();
+        if (ImGui::Checkbox("Adaptive steps", &adaptiveSteps))
+            changes.push_back([this, adaptiveSteps] { physicsIntegrator->setAdaptiveSteps(adaptiveSteps); });
+        if (adaptiveSteps) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(%d steps)", physicsIntegrator->getLastStepCount());
+            int maxSteps = physicsIntegrator->getMaxSteps();
+            if (ImGui::InputInt("maxSteps", &maxSteps, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue))
+                changes.push_back([this, maxSteps] { physicsIntegrator->setMaxSteps(maxSteps); });
+            float targetMotion = physicsIntegrator->getTargetMotion();
+            if (ImGui::DragFloat("target motion", &targetMotion, 0.001f, 0.001f, 1.0f, "%.3f"))
+                changes.push_back([this, targetMotion] { physicsIntegrator->setTargetMotion(targetMotion); });
+            float frameBudget = physicsIntegrator->getFrameBudget() * 1000.0f;
+            if (ImGui::DragFloat("frame budget (ms)", &frameBudget, 0.1f, 0.0f, 100.0f, "%.1f"))
+                changes.push_back([this, frameBudget] { physicsIntegrator->setFrameBudget(frameBudget / 1000.0f); });
+        }
+        bool continuousCollisions = physicsIntegrator->getContinuousCollisions();
+        if (ImGui::Checkbox("Continuous collisions", &continuousCollisions))
+            changes.push_back([this, continuousCollisions] { physicsIntegrator->setContinuousCollisions(continuousCollisions); });
+        bool hairCollisions = physicsIntegrator->getHairCollisions();
+        if (ImGui::Checkbox("Hair collisions", &hairCollisions))
+            changes.push_back([this, hairCollisions] { physicsIntegrator->setHairCollisions(hairCollisions); });
+        if (hairCollisions) {
+            HairCollision& hairCollision = physicsIntegrator->getHairCollision();
+            ImGui::SameLine();
+            ImGui::TextDisabled("(%zu contacts)", hairCollision.numContacts.load());
+            float radius = hairCollision.radius;
+            if (ImGui::DragFloat("strand radius", &radius, 0.0001f, 0.0001f, 0.1f, "%.4f"))
+                changes.push_back([&hairCollision, radius] { hairCollision.radius = radius; });
+            int iterations = hairCollision.iterations;
+            if (ImGui::DragInt("collision iterations", &iterations, 0.1f, 1, 10))
+                changes.push_back([&hairCollision, iterations] { hairCollision.iterations = iterations; });
+        }
+        bool batchKernel = physicsIntegrator->getBatchKernel();
+        if (ImGui::Checkbox("Batch kernel", &batchKernel))
+            changes.push_back([this, batchKernel] { physicsIntegrator->setBatchKernel(batchKernel); });
+        ImGui::SameLine();
+        ImGui::TextDisabled("(%s)", rodkernels::isaName(physicsIntegrator->getISA()));
+        // Step length, solver and contact changes all move settled hair
+        ApplyChanges(true);
     }
 }
 
@@ -304,18 +370,51 @@ void GUIManager::DrawRodParameters()
         auto width = ImGui::GetContentRegionAvail().x;
         ImGui::PushItemWidth(width * 0.45f);
 
-        ImGui::DragFloat3("gravity",
-                          &ElasticRod::gravity[0], 0.001f, -50.0f, 50.0f);
-        ImGui::DragFloat("drag",
-                         &ElasticRod::drag, 0.0001f, 0.0f, 400.0f, "%.4f");
-        ImGui::DragFloat("inextensibility",
-                         &ElasticRod::inextensibility, 0.0001f, 0.0f, 1.0f, "%.4f");
-        ImGui::DragFloat("bending modulus",
-                         &ElasticRod::alpha, 0.0001f, 0.0f, 1.0f, "%.4f");
-        ImGui::DragFloat("Voxel Friciton",
-                         &ElasticRod::friction, 0.001f, 0.0f, 1.0f);
-        ImGui::DragFloat("Sample Scaling",
-                         &ElasticRod::sampledVelocityScale, 0.1f, 0.0f, 100.0f);
+        // Widgets edit copies of the rod constants, a changed one is queued as
+        // an assignment to the constant it was copied from
+        auto dragFloat = [this](const char* label, float& value, float speed, float min, float max, const char* format = "%.3f") {
+            float edited = value;
+            if (ImGui::DragFloat(label, &edited, speed, min, max, format))
+                changes.push_back([&value, edited] { value = edited; });
+        };
+        auto dragInt = [this](const char* label, int& value, float speed, int min, int max) {
+            int edited = value;
+            if (ImGui::DragInt(label, &edited, speed, min, max))
+                changes.push_back([&value, edited] { value = edited; });
+        };
+        auto checkbox = [this](const char* label, bool& value) {
+            bool edited = value;
+            if (ImGui::Checkbox(label, &edited))
+                changes.push_back([&value, edited] { value = edited; });
+        };
+
+        Vector3f gravity = ElasticRodBase::gravity;
+        if (ImGui::DragFloat3("gravity", &gravity[0], 0.001f, -50.0f, 50.0f))
+            changes.push_back([gravity] { ElasticRodBase::gravity = gravity; });
+        dragFloat("drag", ElasticRodBase::drag, 0.0001f, 0.0f, 400.0f, "%.4f");
+        dragFloat("inextensibility", ElasticRodBase::inextensibility, 0.0001f, 0.0f, 1.0f, "%.4f");
+        dragFloat("bending modulus", ElasticRodBase::alpha, 0.0001f, 0.0f, 1.0f, "%.4f");
+        dragFloat("twisting modulus", ElasticRodBase::beta, 0.0001f, 0.0f, 10.0f, "%.4f");
+        dragFloat("stretch stiffness", ElasticRodBase::stretchStiffness, 100.0f, 0.0f, 1e7f, "%.0f");
+        checkbox("quasi-static twist", ElasticRodBase::quasiStaticTwist);
+        dragFloat("Voxel Friciton", ElasticRodBase::friction, 0.001f, 0.0f, 1.0f);
+        dragFloat("Sample Scaling", ElasticRodBase::sampledVelocityScale, 0.1f, 0.0f, 100.0f);
+        dragFloat("voxel size", scene->voxelGrid->voxelSize, 0.001f, 0.01f, 10.0f, "%.3f");
+        ImGui::SameLine();
+        ImGui::TextDisabled("(%zu voxels)", physicsIntegrator->getOccupiedVoxels());
+        dragFloat("volume stiffness", ElasticRodBase::volumeStiffness, 0.001f, 0.0f, 10.0f, "%.3f");
+        dragFloat("rest density", ElasticRodBase::restDensity, 0.1f, 0.0f, 1000.0f, "%.1f");
+        dragInt("XPBD iterations", ElasticRodBase::xpbdIterations, 0.1f, 1, 50);
+        dragFloat("XPBD bend compliance", ElasticRodBase::bendCompliance, 1e-7f, 0.0f, 1e-2f, "%.7f");
+        dragFloat("FTL damping", ElasticRodBase::ftlDamping, 0.001f, 0.0f, 1.0f);
+        checkbox("sleeping", ElasticRodBase::allowSleep);
+        // Settled rods sleep, so any change above has to wake them
+        ApplyChanges(true);
+        dragFloat("sleep speed", ElasticRodBase::sleepSpeed, 0.0001f, 0.0f, 1.0f, "%.4f");
+        dragFloat("sleep correction", ElasticRodBase::sleepCorrection, 0.001f, 0.0f, 1.0f, "%.3f");
+        ImGui::SameLine();
+        ImGui::TextDisabled("(%d asleep)", physicsIntegrator->getSleepingRods());
+        ApplyChanges(false);
         ImGui::PopItemWidth();
 
         if (ImGui::Button("reset"))
@@ -333,6 +432,32 @@ void GUIManager::DrawTimerInfo()
                         stats::avgRenderTime * 1000.f, 1.f/stats::avgRenderTime);
     ImGui::TextColored(ImVec4(0.1, 0.1, 0.1, 1), "Physics time: %.3fms (%.1f UPS)",
                         stats::avgPhysicsTime * 1000.f, 1.f/stats::avgPhysicsTime);
+    ImGui::TextColored(ImVec4(0.1, 0.1, 0.1, 1), "Step time: DER %.3fms, XPBD %.3fms",
+                        physicsIntegrator->getAvgStepTime(PhysicsIntegrator::Solver::DER) * 1000.f,
+                        physicsIntegrator->getAvgStepTime(PhysicsIntegrator::Solver::XPBD) * 1000.f);
+    if (physicsIntegrator->getHairCollisions()) {
+        const HairCollision& hairCollision = physicsIntegrator->getHairCollision();
+        ImGui::TextColored(ImVec4(0.1, 0.1, 0.1, 1), "Hair collision: broad %.3fms, narrow %.3fms, resolve %.3fms",
+                            hairCollision.broadPhaseTime.load() * 1000.f, hairCollision.narrowPhaseTime.load() * 1000.f,
+                            hairCollision.resolveTime.load() * 1000.f);
+        ImGui::TextColored(ImVec4(0.1, 0.1, 0.1, 1), "%zu segments, %zu candidates, %zu contacts",
+                            hairCollision.numSegments.load(), hairCollision.numCandidates.load(), hairCollision.numContacts.load());
+    }
+}
+
+void GUIManager::ApplyChanges(bool wake)
+{
+    if (changes.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(scene->simulationMutex);
+    for (auto& change : changes) {
+        change();
+    }
+    changes.clear();
+    if (wake) {
+        physicsIntegrator->WakeAll();
+    }
 }
 
 void GUIManager::Terminate()
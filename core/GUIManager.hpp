@@ -2,6 +2,8 @@
 
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <functional>
 
 #include <imgui.h>
 #include <glad/glad.h>
@@ -52,4 +54,13 @@ private:
     void DrawRodParameters();
 
     void DrawTimerInfo();
+
+    // Position, rotation and scale of an object the colliders read while stepping
+    void DrawTransformControls(SceneObject& object, int id);
+
+    // The physics thread reads the simulation state while stepping, so widgets
+    // edit copies and queue their writes here for ApplyChanges()
+    std::vector<std::function<void()>> changes;
+    // Runs the queued writes under simulationMutex, waking sleeping rods if asked
+    void ApplyChanges(bool wake);
 };
\ No newline at end of file
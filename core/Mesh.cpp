@@ -4,6 +4,7 @@
 #include <ElasticRod.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <array>
+#include <algorithm>
 
 uint64_t cantor(uint32_t x, uint32_t y) {
     return ((x + y) * (x + y + 1u)) / 2u + y;
@@ -116,13 +117,48 @@ void HairMesh::draw(const OpenGLProgram &prog)
     glDrawElements(GL_LINES, numInterpElements(), GL_UNSIGNED_INT, nullptr) $gl_chk;
 }
 
-void HairMesh::updateFrom(const ElasticRod& rod, size_t idx)
+void HairMesh::updateFrom(const RodBatch& batch, std::chrono::steady_clock::time_point time, float period)
 {
-    for (size_t i = 0; i < controlHairLen; i++)
+    assert(batch.numVerts() == controlHairLen);
+    backTick.current.resize(batch.numRods() * controlHairLen);
+    for (size_t r = 0; r < batch.numRods(); r++)
     {
-        Eigen::Vector3f x = rod.x[i];
-        controlVerts[controlHairLen * idx + i] = glm::vec4(x[0], x[1], x[2], 1.0f);
+        for (size_t i = 0; i < controlHairLen; i++)
+        {
+            const size_t idx = batch.index(r, i);
+            backTick.current[controlHairLen * r + i] = glm::vec4(batch.px[idx], batch.py[idx], batch.pz[idx], 1.0f);
+        }
     }
+    // The first tick has nothing before it and holds still
+    backTick.previous = lastVerts.size() == backTick.current.size() ? lastVerts : backTick.current;
+    lastVerts = backTick.current;
+    backTick.time = time;
+    backTick.period = period;
+
+    std::lock_guard<std::mutex> lock(swapMutex);
+    std::swap(backTick, readyTick);
+    readyFresh = true;
+}
+
+bool HairMesh::interpolate(std::chrono::steady_clock::time_point time)
+{
+    {
+        std::lock_guard<std::mutex> lock(swapMutex);
+        if (readyFresh)
+        {
+            std::swap(frontTick, readyTick);
+            readyFresh = false;
+        }
+    }
+    if (frontTick.current.empty())
+        return false;
+
+    // At the time a tick was due this shows the state before it, a period later the tick itself
+    const float alpha = std::clamp(std::chrono::duration<float>(time - frontTick.time).count() / frontTick.period, 0.0f, 1.0f);
+    controlVerts.resize(frontTick.current.size());
+    for (size_t i = 0; i < controlVerts.size(); i++)
+        controlVerts[i] = glm::mix(frontTick.previous[i], frontTick.current[i], alpha);
+    return true;
 }
 
 void HairMesh::bindToComputeShader(ComputeShader &cs) const
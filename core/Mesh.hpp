@@ -5,9 +5,11 @@
 #include <Renderer.hpp>
 #include <unordered_map>
 #include <string>
+#include <chrono>
+#include <mutex>
 
 class ComputeShader;
-class ElasticRod;
+class RodBatch;
 
 class Mesh
 {
@@ -41,11 +43,28 @@ private:
     GLuint eboInterp = GL_INVALID_INDEX;
     // EBO for triangles
     GLuint eboTris = GL_INVALID_INDEX;
+    // A physics tick as published: control vertices before and after it, the wall
+    // time it was due at and the wall time between ticks
+    struct Tick
+    {
+        std::vector<glm::vec4> previous;
+        std::vector<glm::vec4> current;
+        std::chrono::steady_clock::time_point time;
+        float period = 0.0f;
+    };
+    // Triple buffer between the physics thread, which fills backTick, and the render
+    // thread, which draws from frontTick. Publishing and acquiring only swap ticks with
+    // readyTick under swapMutex, so neither thread waits for the other's work.
+    Tick backTick, readyTick, frontTick;
+    bool readyFresh = false;
+    std::mutex swapMutex;
+    // Vertices of the last published tick, kept by the physics thread
+    std::vector<glm::vec4> lastVerts;
 
     // Grow control hair from a root position and direction, adding to my vertices and indices
     void growControlHair(const glm::vec3& root, const glm::vec3& dir);
 public:
-    // Vertices for control hairs
+    // Vertices for control hairs, as last interpolated for drawing
     std::vector<glm::vec4> controlVerts;
     // Number of vertices in each control hair (N)
     static constexpr uint32_t controlHairLen = 10;
@@ -69,7 +88,13 @@ public:
     void updateBuffer();
     void loadFromFile(const std::string &modelPath, bool compNormals = true) override;
     void draw(const OpenGLProgram& prog) override;
-    void updateFrom(const ElasticRod& rod, size_t idx);
+    // Publishes the rod positions as the tick due at time, period seconds after the
+    // previous one. Called by the physics thread.
+    void updateFrom(const RodBatch& batch, std::chrono::steady_clock::time_point time, float period);
+    // Sets controlVerts to the hair at time, blending the two latest ticks one tick
+    // behind the simulation, so motion stays smooth when physics ticks less often than
+    // frames are drawn. False until the first tick is published.
+    bool interpolate(std::chrono::steady_clock::time_point time);
 
     void bindToComputeShader(ComputeShader& cs) const;
 
@@ -158,4 +183,9 @@ public:
     void build(const OpenGLProgram& prog) override;
     // Draws the hair mesh
     void draw(const OpenGLProgram& prog) override;
+
+    // Vertex positions, split where normals or texture coordinates differ
+    const std::vector<glm::vec3>& getVertices() const { return vertices; }
+    // Triangle list indexing getVertices()
+    const std::vector<GLuint>& getIndices() const { return indices; }
 };
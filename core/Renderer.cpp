@@ -199,16 +199,13 @@ void Renderer::RenderSurfaces()
 void Renderer::RenderSurface(SceneObject& sceneObj, OpenGLProgram& prog)
 {
     prog.Use();
-    glm::mat4 IDENTITY_MAT4  = glm::mat4(1.0f);
-    glm::mat4 model_transform = glm::translate(IDENTITY_MAT4, sceneObj.position) 
-                            * glm::eulerAngleZYX(glm::radians(sceneObj.rotation.z), 
-                                                glm::radians(sceneObj.rotation.y), 
-                                                glm::radians(sceneObj.rotation.x)) 
-                            * glm::scale(IDENTITY_MAT4, sceneObj.scale);
-
-    glm::mat4 to_view_space = scene->cam.view() * model_transform;
+    const glm::mat4& model_transform = sceneObj.modelMatrix;
+
+    const glm::mat4 view = scene->cam.view();
+    glm::mat4 to_view_space = view * model_transform;
     glm::mat4 to_clip_space = scene->cam.proj({windowSize}) * to_view_space;
-    glm::mat3 normals_to_view_space = glm::mat3(glm::transpose(glm::inverse(to_view_space)));
+    //the view is rigid, so only the model part needs the cached inverse transpose
+    glm::mat3 normals_to_view_space = glm::mat3(view) * glm::transpose(glm::mat3(sceneObj.inverseModelMatrix));
     prog.SetUniform("to_clip_space", to_clip_space);// mvp
     prog.SetUniform("to_view_space", to_view_space);//mv
     prog.SetUniform("normals_to_view_space", normals_to_view_space);//mv for normals
@@ -231,5 +228,6 @@ void Renderer::RenderSurface(SceneObject& sceneObj, OpenGLProgram& prog)
 
 void Renderer::PostPhysicsSync()
 {
-    scene->hairMesh.updateBuffer();
+    if (scene->hairMesh.interpolate(std::chrono::steady_clock::now()))
+        scene->hairMesh.updateBuffer();
 }
\ No newline at end of file
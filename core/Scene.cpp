@@ -1,5 +1,7 @@
 #include <Scene.hpp>
 #include <Renderer.hpp>
+#include <SDFCollider.hpp>
+#include <algorithm>
 
 Scene::Scene()
 {
@@ -9,6 +11,7 @@ Scene::Scene()
 
 void Scene::init(const Renderer& r)
 {
+    renderer = &r;
     hairMesh.loadFromFile("resources/sphere.obj");
     hairMesh.build(r.hairProg);
 
@@ -19,11 +22,13 @@ void Scene::init(const Renderer& r)
         }
         rods.emplace_back(ctrlHair);
     }
+    rodBatch.init(rods);
 
     surface = std::make_shared<SceneObject>();
     surface->mesh.loadFromFile("resources/sphere.obj");
     surface->mesh.build(r.surfaceProg);
     surface->collider = std::make_shared<SphereCollider>(Eigen::Vector3f(0.0f,0.0f,0.0f), 1.0f);
+    surface->setTransform();
     sceneObjects.push_back(surface);
 
     dummy = std::make_shared<SceneObject>();
@@ -31,7 +36,9 @@ void Scene::init(const Renderer& r)
     dummy->mesh.build(r.surfaceProg);
     dummy->position = {0.0f, 2.0f, 0.0f};
     dummy->scale /= 2.0f;
-    dummy->collider = std::make_shared<SphereCollider>(Eigen::Vector3f(0.0f,0.0f,0.0f), 0.5f);
+    //collider sizes are in the mesh's own space, the transform scales them
+    dummy->collider = std::make_shared<SphereCollider>(Eigen::Vector3f(0.0f,0.0f,0.0f), 1.0f);
+    dummy->setTransform();
     sceneObjects.push_back(dummy);
 
     //set Marschner luts
@@ -73,11 +80,32 @@ void Scene::init(const Renderer& r)
 }
 
 
+void Scene::setDummyModel(const std::string& modelPath)
+{
+    auto object = std::make_shared<SceneObject>();
+    object->mesh.loadFromFile(modelPath);
+    object->mesh.build(renderer->surfaceProg);
+    const Eigen::Vector3f center(&dummy->position[0]);
+    if (fs::path(modelPath).filename() == "sphere.obj") {
+        object->collider = std::make_shared<SphereCollider>(center, 1.0f);
+    } else {
+        object->collider = std::make_shared<SDFCollider>(center, object->mesh, modelPath + ".sdf");
+    }
+    object->setTransform(dummy->position, dummy->rotation, dummy->scale);
+    //the mesh and its field are built above, only the swap waits for physics
+    std::lock_guard<std::mutex> lock(simulationMutex);
+    std::replace(sceneObjects.begin(), sceneObjects.end(), dummy, object);
+    dummy = object;
+}
+
 void Scene::reset()
 {
-    for (ElasticRod& rod : rods) {
+    std::lock_guard<std::mutex> lock(simulationMutex);
+    for (auto& rod : rods) {
         rod.reset();
     }
+    // Frames and root edges are reset along with positions, so copy the whole state
+    rodBatch.gather(rods);
 }
 
 glm::mat4 Scene::Light::CalculateLightSpaceMatrix() const
@@ -104,11 +132,20 @@ void SceneObject::setTransform(const glm::vec3 &pos, const glm::vec3 &rot, const
     this->position = pos;
     this->rotation = rot;
     this->scale = scale;
-    this->collider->center = Eigen::Vector3f(&pos[0]);
+    setTransform();
 }
 
 void SceneObject::setTransform()
 {
-    this->collider->center = Eigen::Vector3f(&position[0]);
-    ///TODO: set rotation and scale
+    this->modelMatrix = glm::translate(glm::mat4(1.0f), position)
+                      * glm::eulerAngleZYX(glm::radians(rotation.z),
+                                           glm::radians(rotation.y),
+                                           glm::radians(rotation.x))
+                      * glm::scale(glm::mat4(1.0f), scale);
+    this->inverseModelMatrix = glm::inverse(modelMatrix);
+    const glm::mat3 linear(modelMatrix);
+    const glm::mat3 inverseLinear(inverseModelMatrix);
+    this->collider->SetTransform(Eigen::Vector3f(&position[0]),
+                                 Eigen::Map<const Eigen::Matrix3f>(&linear[0][0]),
+                                 Eigen::Map<const Eigen::Matrix3f>(&inverseLinear[0][0]));
 }
@@ -5,6 +5,8 @@
 #include <ElasticRod.hpp>
 #include <Collider.hpp>
 #include <VoxelGrid.hpp>
+#include <RodBatch.hpp>
+#include <mutex>
 
 class Renderer;
 
@@ -17,10 +19,14 @@ struct SceneObject
     glm::vec3 position = glm::vec3(0.0f);
     glm::vec3 rotation = glm::vec3(0.0f);
     glm::vec3 scale = glm::vec3(1.0f);
+    // Built from the parameters above by setTransform(), together with its inverse, and
+    // shared by the renderer and the collider so neither rebuilds them every frame
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+    glm::mat4 inverseModelMatrix = glm::mat4(1.0f);
 
     // Sets position, rotation and scale from given arguments
     void setTransform(const glm::vec3& pos, const glm::vec3& rot, const glm::vec3& scale);
-    // Updates position, rotation and scale from stored variables
+    // Updates the model matrices and the collider's transform from the stored variables
     void setTransform();
 };
 
@@ -30,8 +36,13 @@ public:
     HairMesh hairMesh;
     std::shared_ptr<SceneObject> surface, dummy;
     std::vector<std::shared_ptr<SceneObject>> sceneObjects;
-    std::vector<ElasticRod> rods;
+    std::vector<ElasticRod<HairMesh::controlHairLen>> rods;
+    // Flat SoA copy of the rod state, published to the renderer
+    RodBatch rodBatch;
     std::shared_ptr<VoxelGrid> voxelGrid;
+    // Held by the physics thread while it steps the simulation. Other threads lock it
+    // to change the rods or swap scene objects.
+    std::mutex simulationMutex;
     Camera cam;
     struct Light {
         glm::vec3 dir = glm::vec3(-3.7f, 0.5f, -5.1f);
@@ -53,8 +64,12 @@ public:
 
     // Called by Renderer::Initialize()
     void init(const Renderer& r);
-    // Resets entire simulation
+    // Resets entire simulation, waiting for the physics thread to finish its frame
     void reset();
+    // Replaces the dummy collider's mesh, keeping its transform. sphere.obj keeps an
+    // analytic sphere collider, other meshes get an SDFCollider cached next to the model.
+    void setDummyModel(const std::string& modelPath);
 private:
-    /* data */
+    // Set by init(), meshes loaded later are built with its programs
+    const Renderer* renderer = nullptr;
 };
\ No newline at end of file
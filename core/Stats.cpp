@@ -1,10 +1,10 @@
 #include <Stats.hpp>
 
-float stats::avgFrameTime = 0.0f;
-float stats::lastFrameTime = 0.0f;
+std::atomic<float> stats::avgFrameTime = 0.0f;
+std::atomic<float> stats::lastFrameTime = 0.0f;
 
-float stats::avgPhysicsTime = 0.0f;
-float stats::lastPhysicsTime = 0.0f;
+std::atomic<float> stats::avgPhysicsTime = 0.0f;
+std::atomic<float> stats::lastPhysicsTime = 0.0f;
 
-float stats::avgRenderTime = 0.0f;
-float stats::lastRenderTime = 0.0f;
\ No newline at end of file
+std::atomic<float> stats::avgRenderTime = 0.0f;
+std::atomic<float> stats::lastRenderTime = 0.0f;
\ No newline at end of file
@@ -1,12 +1,16 @@
 #pragma once
+#include <atomic>
+
+// Timings shown in the GUI. The physics thread writes its own while the render
+// thread reads them, so they are atomic.
 struct stats
 {
-    static float avgFrameTime;
-    static float lastFrameTime;
+    static std::atomic<float> avgFrameTime;
+    static std::atomic<float> lastFrameTime;
 
-    static float avgPhysicsTime;
-    static float lastPhysicsTime;
+    static std::atomic<float> avgPhysicsTime;
+    static std::atomic<float> lastPhysicsTime;
 
-    static float avgRenderTime;
-    static float lastRenderTime;
+    static std::atomic<float> avgRenderTime;
+    static std::atomic<float> lastRenderTime;
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Solvers for symmetric positive definite systems with half-bandwidth P.
+// Only the lower band is stored, row i holds columns i-P..i at
+// band[i * (P + 1) + (j - i + P)], so an n x n system takes n * (P + 1) floats.
+// at() and solve() take any element type with + - * /, such as the packets of
+// the rod kernels.
+namespace banded
+{
+    template <int P, typename T>
+    inline T& at(T* band, int i, int j)
+    {
+        return band[i * (P + 1) + (j - i + P)];
+    }
+
+    template <int P, typename T>
+    inline const T& at(const T* band, int i, int j)
+    {
+        return band[i * (P + 1) + (j - i + P)];
+    }
+
+    // In-place Cholesky factorization A = L L^T in O(n P^2), false if A is not positive definite
+    template <int P>
+    bool cholesky(float* band, int n)
+    {
+        for (int i = 0; i < n; i++) {
+            const int first = std::max(0, i - P);
+            for (int j = first; j <= i; j++) {
+                float sum = at<P>(band, i, j);
+                for (int k = first; k < j; k++) {
+                    sum -= at<P>(band, i, k) * at<P>(band, j, k);
+                }
+                if (j < i) {
+                    at<P>(band, i, j) = sum / at<P>(band, j, j);
+                } else if (sum > 0.0f) {
+                    at<P>(band, i, i) = std::sqrt(sum);
+                } else {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Solves L L^T x = b in place, using the factor produced by cholesky()
+    template <int P, typename T>
+    void solve(const T* band, int n, T* b)
+    {
+        for (int i = 0; i < n; i++) {
+            T sum = b[i];
+            for (int k = std::max(0, i - P); k < i; k++) {
+                sum = sum - at<P>(band, i, k) * b[k];
+            }
+            b[i] = sum / at<P>(band, i, i);
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            T sum = b[i];
+            for (int k = i + 1; k <= std::min(n - 1, i + P); k++) {
+                sum = sum - at<P>(band, k, i) * b[k];
+            }
+            b[i] = sum / at<P>(band, i, i);
+        }
+    }
+}
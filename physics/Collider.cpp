@@ -1,32 +1,51 @@
 #include <Collider.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 Collider::Collider(Eigen::Vector3f center) 
     : center(center) {}
 
+void Collider::SetTransform(const Eigen::Vector3f& center, const Eigen::Matrix3f& linear, const Eigen::Matrix3f& inverseLinear) {
+    this->center = center;
+    toWorld = linear;
+    toLocal = inverseLinear;
+}
+
+void Collider::GetBounds(Eigen::Vector3f& lower, Eigen::Vector3f& upper) const {
+    lower = Eigen::Vector3f::Constant(-std::numeric_limits<float>::infinity());
+    upper = Eigen::Vector3f::Constant(std::numeric_limits<float>::infinity());
+}
+
 SphereCollider::SphereCollider(Eigen::Vector3f center, float radius)
     : Collider(center), radius(radius) {}
 
 float SphereCollider::GetBoundaryAt(Eigen::Vector3f pos) {
-    return radius;
+    const Eigen::Vector3f local = ToLocal(pos);
+    const float dist = local.norm();
+    if (dist == 0.0f) {
+        return radius * MinScale();
+    }
+    return (toWorld * local * (radius / dist)).norm();
 }
 
 bool SphereCollider::IsCollidingWith(Collider& other, CollisionInfo& collision) {
     //apply minkowski difference
     Eigen::Vector3f diff = center - other.center;
     float dist = diff.norm();
-    float boundary = GetBoundaryAt(diff) + other.GetBoundaryAt(-diff);
+    float boundary = GetBoundaryAt(other.center) + other.GetBoundaryAt(center);
 
     collision.normal = diff / dist;
     collision.penetration = dist - boundary;
 
-    return dist < radius;
+    return ToLocal(other.center).squaredNorm() < radius * radius;
 }
 
 BoxCollider::BoxCollider(Eigen::Vector3f center, Eigen::Vector3f size)
     : Collider(center), size(size) {}
 
 float BoxCollider::GetBoundaryAt(Eigen::Vector3f pos) {
-    Eigen::Vector3f direction = pos - center; // calculate direction from center to pos
+    Eigen::Vector3f direction = ToLocal(pos); // direction from center to pos, in the box's space
     Eigen::Vector3f halfSize = size / 2.0f;   // calculate half of the box size in each dimension
 
     // calculate the distances to the boundary planes in each dimension
@@ -35,17 +54,51 @@ float BoxCollider::GetBoundaryAt(Eigen::Vector3f pos) {
     //project glm::compMin(d) onto the direction vector
     float distance = direction.dot(d.normalized());
 
-    return distance;
+    //back to world lengths along the direction
+    const float length = direction.norm();
+    return length > 0.0f ? distance * (toWorld * direction).norm() / length : distance;
 }
 
 bool BoxCollider::IsCollidingWith(Collider& other, CollisionInfo& collision) {
     //apply minkowski difference
     Eigen::Vector3f diff = center - other.center;
     float dist = diff.norm();
-    float boundary = GetBoundaryAt(diff) + other.GetBoundaryAt(-diff);
+    float boundary = GetBoundaryAt(other.center) + other.GetBoundaryAt(center);
 
     collision.normal = diff / dist;
     collision.penetration = dist - boundary;
 
     return dist < boundary;
-}
\ No newline at end of file
+}
+
+CapsuleCollider::CapsuleCollider(Eigen::Vector3f center, Eigen::Vector3f halfAxis, float radius)
+    : Collider(center), halfAxis(halfAxis), radius(radius) {}
+
+Eigen::Vector3f CapsuleCollider::ClosestSurfacePoint(const Eigen::Vector3f& pos) const {
+    //closest in the capsule's own space, which is only approximate under non-uniform scale
+    const Eigen::Vector3f local = ToLocal(pos);
+    const float len2 = halfAxis.squaredNorm();
+    const float t = len2 > 0.0f ? std::clamp(local.dot(halfAxis) / len2, -1.0f, 1.0f) : 0.0f;
+    const Eigen::Vector3f axisPoint = t * halfAxis;
+    const Eigen::Vector3f diff = local - axisPoint;
+    const float dist = diff.norm();
+    return dist > 0.0f ? ToWorld(axisPoint + diff * (radius / dist)) : pos;
+}
+
+bool CapsuleCollider::IsCollidingWith(Collider& other, CollisionInfo& collision) {
+    //the normal points from the closest surface point to center, like SphereCollider's
+    const Eigen::Vector3f surface = ClosestSurfacePoint(other.center);
+    const Eigen::Vector3f diff = center - surface;
+    const float dist = diff.norm();
+    collision.normal = dist > 0.0f ? Eigen::Vector3f(diff / dist) : Eigen::Vector3f::Zero();
+    const Eigen::Vector3f local = ToLocal(other.center);
+    const float len2 = halfAxis.squaredNorm();
+    const float t = len2 > 0.0f ? std::clamp(local.dot(halfAxis) / len2, -1.0f, 1.0f) : 0.0f;
+    const bool inside = (local - t * halfAxis).squaredNorm() < radius * radius;
+    collision.penetration = (inside ? -1.0f : 1.0f) * (other.center - surface).norm();
+    return inside;
+}
+
+float CapsuleCollider::GetBoundaryAt(Eigen::Vector3f pos) {
+    return (center - ClosestSurfacePoint(pos)).norm();
+}
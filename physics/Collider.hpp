@@ -20,11 +20,38 @@ public:
     * Returns the distance from center of the collider in the direction from the center to pos
     */
     virtual float GetBoundaryAt(Eigen::Vector3f pos) = 0;
+    // Batch queries ColliderSet falls back to for collider types it does not pack by
+    // type. The types it packs keep these defaults: unbounded and never colliding.
+    // Axis-aligned bounds of the collider, points outside them never collide
+    virtual void GetBounds(Eigen::Vector3f& lower, Eigen::Vector3f& upper) const;
+    // Moves every point inside the collider to the closest point on its surface
+    virtual void ResolvePoints(Eigen::Vector3f* points, size_t count) const {}
+    // Returns true if any of the points is inside the collider
+    virtual bool AnyInside(const Eigen::Vector3f* points, size_t count) const { return false; }
+
+    /*
+    * Places the collider so that a point p of its own space is at center + linear * p,
+    * where linear holds its rotation and scale. inverseLinear is the inverse of linear,
+    * usually cached by the owner alongside the render transform.
+    */
+    void SetTransform(const Eigen::Vector3f& center, const Eigen::Matrix3f& linear, const Eigen::Matrix3f& inverseLinear);
+    // World position pos in the collider's own space
+    Eigen::Vector3f ToLocal(const Eigen::Vector3f& pos) const { return toLocal * (pos - center); }
+    // Position local of the collider's own space in world space
+    Eigen::Vector3f ToWorld(const Eigen::Vector3f& local) const { return center + toWorld * local; }
+    // Normal of the collider's own space in world space, normalized
+    Eigen::Vector3f NormalToWorld(const Eigen::Vector3f& normal) const { return (toLocal.transpose() * normal).normalized(); }
+    // Smallest factor the transform scales lengths by
+    float MinScale() const { return toWorld.colwise().norm().minCoeff(); }
 
     float elasticity = 1.0f;
     float friction = 0.0f;
     Eigen::Vector3f center;
-private:
+    // Linear part of the transform from the collider's own space to world space and its
+    // inverse, set through SetTransform(). Collider parameters such as a sphere's radius
+    // are in its own space.
+    Eigen::Matrix3f toWorld = Eigen::Matrix3f::Identity();
+    Eigen::Matrix3f toLocal = Eigen::Matrix3f::Identity();
 };
 
 class SphereCollider : public Collider
@@ -47,4 +74,23 @@ public:
     float GetBoundaryAt(Eigen::Vector3f pos) override;
 
     Eigen::Vector3f size;
+};
+
+class CapsuleCollider : public Collider
+{
+public:
+    // Capsule of the given radius around the segment center +- halfAxis
+    CapsuleCollider(Eigen::Vector3f center, Eigen::Vector3f halfAxis, float radius);
+
+    bool IsCollidingWith(Collider& other, CollisionInfo& collision) override;
+    /*
+    * Returns the distance from center to the surface point closest to pos
+    */
+    float GetBoundaryAt(Eigen::Vector3f pos) override;
+
+    // Closest surface point to pos, inside or outside
+    Eigen::Vector3f ClosestSurfacePoint(const Eigen::Vector3f& pos) const;
+
+    Eigen::Vector3f halfAxis;
+    float radius;
 };
\ No newline at end of file
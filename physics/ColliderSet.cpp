@@ -0,0 +1,627 @@
+#include <ColliderSet.hpp>
+#include <SDFCollider.hpp>
+#include <Scene.hpp>
+#include <algorithm>
+#include <cmath>
+
+using Eigen::Matrix3f;
+using Eigen::Vector3f;
+
+namespace
+{
+    constexpr int lanes = ColliderSet::blockSize;
+
+    // Up to blockSize points as separate coordinate lanes, lanes past count repeat
+    // the last point so every loop runs the full, fixed width
+    struct PointBlock
+    {
+        alignas(64) float x[lanes];
+        alignas(64) float y[lanes];
+        alignas(64) float z[lanes];
+        Vector3f lower, upper;
+
+        PointBlock(const Vector3f* points, int count)
+        {
+            lower = upper = points[0];
+            for (int l = 0; l < lanes; l++) {
+                const Vector3f& p = points[std::min(l, count - 1)];
+                x[l] = p.x();
+                y[l] = p.y();
+                z[l] = p.z();
+                lower = lower.cwiseMin(p);
+                upper = upper.cwiseMax(p);
+            }
+        }
+
+        void store(Vector3f* points, int count) const
+        {
+            for (int l = 0; l < count; l++) {
+                points[l] = Vector3f(x[l], y[l], z[l]);
+            }
+        }
+    };
+
+    // A 3x3 matrix copied out as plain floats, column-major, so lane loops keep its
+    // entries in registers rather than reloading them through a pointer
+    struct Linear
+    {
+        float m[9];
+
+        explicit Linear(const Matrix3f& matrix)
+        {
+            std::copy(matrix.data(), matrix.data() + 9, m);
+        }
+
+        float operator()(int row, int col) const { return m[row + 3 * col]; }
+    };
+
+    // The lanes of a block in a collider's own space, for a collider at origin
+    struct LocalBlock
+    {
+        alignas(64) float x[lanes];
+        alignas(64) float y[lanes];
+        alignas(64) float z[lanes];
+
+        LocalBlock(const PointBlock& b, const Vector3f& origin, const Matrix3f& toLocal)
+        {
+            const Linear m(toLocal);
+            const float ox = origin.x(), oy = origin.y(), oz = origin.z();
+            for (int l = 0; l < lanes; l++) {
+                const float dx = b.x[l] - ox;
+                const float dy = b.y[l] - oy;
+                const float dz = b.z[l] - oz;
+                x[l] = m(0, 0) * dx + m(0, 1) * dy + m(0, 2) * dz;
+                y[l] = m(1, 0) * dx + m(1, 1) * dy + m(1, 2) * dz;
+                z[l] = m(2, 0) * dx + m(2, 1) * dy + m(2, 2) * dz;
+            }
+        }
+    };
+
+    // Corrects the lanes of b with resolve, which moves the points of a block given in
+    // the collider's own space, then maps how far they moved back to world space
+    template <typename Resolve>
+    void resolveLocal(const ColliderSet::Frame& frame, PointBlock& b, Resolve resolve)
+    {
+        const LocalBlock before(b, frame.center, frame.toLocal);
+        LocalBlock after = before;
+        resolve(after);
+        const Linear m(frame.toWorld);
+        for (int l = 0; l < lanes; l++) {
+            const float dx = after.x[l] - before.x[l];
+            const float dy = after.y[l] - before.y[l];
+            const float dz = after.z[l] - before.z[l];
+            b.x[l] += m(0, 0) * dx + m(0, 1) * dy + m(0, 2) * dz;
+            b.y[l] += m(1, 0) * dx + m(1, 1) * dy + m(1, 2) * dz;
+            b.z[l] += m(2, 0) * dx + m(2, 1) * dy + m(2, 2) * dz;
+        }
+    }
+
+    // clamp(t, 0, 1) through abs, GCC does not vectorize the nested min and max
+    inline float clamp01(float t)
+    {
+        return 0.5f * (std::abs(t) - std::abs(t - 1.0f) + 1.0f);
+    }
+
+    void resolveSphere(const ColliderSet::Sphere& s, PointBlock& b)
+    {
+        resolveLocal(s.frame, b, [&](LocalBlock& p) {
+            for (int l = 0; l < lanes; l++) {
+                const float dist2 = p.x[l] * p.x[l] + p.y[l] * p.y[l] + p.z[l] * p.z[l];
+                // Points inside move out to the radius and the rest by 0, computed rather
+                // than branched on so the loop vectorizes. A point at the center stays.
+                const float move = std::max(s.radius / std::sqrt(dist2 + 1e-30f) - 1.0f, 0.0f);
+                p.x[l] += p.x[l] * move;
+                p.y[l] += p.y[l] * move;
+                p.z[l] += p.z[l] * move;
+            }
+        });
+    }
+
+    void resolveBox(const ColliderSet::Box& box, PointBlock& b)
+    {
+        const Vector3f& h = box.halfSize;
+        resolveLocal(box.frame, b, [&](LocalBlock& p) {
+            for (int l = 0; l < lanes; l++) {
+                const float lx = p.x[l], ly = p.y[l], lz = p.z[l];
+                // Distance to the nearest face along each axis, the point leaves through the smallest
+                const float ex = h.x() - std::abs(lx);
+                const float ey = h.y() - std::abs(ly);
+                const float ez = h.z() - std::abs(lz);
+                // Masks as 0 or 1 rather than branches so the loop vectorizes, ties go to the first axis
+                const float inside = (float)((ex > 0.0f) & (ey > 0.0f) & (ez > 0.0f));
+                const float pickX = (float)((ex <= ey) & (ex <= ez));
+                const float pickY = (float)((ey < ex) & (ey <= ez));
+                const float pickZ = (float)((ez < ex) & (ez < ey));
+                p.x[l] += inside * pickX * std::copysign(ex, lx);
+                p.y[l] += inside * pickY * std::copysign(ey, ly);
+                p.z[l] += inside * pickZ * std::copysign(ez, lz);
+            }
+        });
+    }
+
+    void resolveCapsule(const ColliderSet::Capsule& c, PointBlock& b)
+    {
+        // Relative to the end point -halfAxis, so the segment runs from 0 to ab
+        const Vector3f& h = c.halfAxis;
+        const Vector3f ab = 2.0f * h;
+        const float invLen2 = ab.squaredNorm() > 0.0f ? 1.0f / ab.squaredNorm() : 0.0f;
+        resolveLocal(c.frame, b, [&](LocalBlock& p) {
+            for (int l = 0; l < lanes; l++) {
+                const float ax = p.x[l] + h.x();
+                const float ay = p.y[l] + h.y();
+                const float az = p.z[l] + h.z();
+                const float t = clamp01((ax * ab.x() + ay * ab.y() + az * ab.z()) * invLen2);
+                const float dx = ax - t * ab.x();
+                const float dy = ay - t * ab.y();
+                const float dz = az - t * ab.z();
+                const float dist2 = dx * dx + dy * dy + dz * dz;
+                const float move = std::max(c.radius / std::sqrt(dist2 + 1e-30f) - 1.0f, 0.0f);
+                p.x[l] += dx * move;
+                p.y[l] += dy * move;
+                p.z[l] += dz * move;
+            }
+        });
+    }
+
+    void resolveSDF(const ColliderSet::SDF& sdf, PointBlock& b)
+    {
+        resolveLocal(sdf.frame, b, [&](LocalBlock& p) {
+            for (int l = 0; l < lanes; l++) {
+                Vector3f normal;
+                const float distance = std::min(sdf.collider->LocalDistance(Vector3f(p.x[l], p.y[l], p.z[l]), normal), 0.0f);
+                p.x[l] -= distance * normal.x();
+                p.y[l] -= distance * normal.y();
+                p.z[l] -= distance * normal.z();
+            }
+        });
+    }
+
+    // Conservative advancement steps of the swept capsule and SDF tests
+    constexpr int advanceIterations = 8;
+
+    // The path of every lane over the step in the own space of a collider, relative
+    // to the collider as it moves: from p to p + d
+    struct LocalPaths
+    {
+        LocalBlock p;
+        LocalBlock d;
+
+        LocalPaths(const ColliderSet::Frame& frame, const PointBlock& s, const PointBlock& b)
+            : p(s, frame.center - frame.motion, frame.toLocal), d(b, frame.center, frame.toLocal)
+        {
+            for (int l = 0; l < lanes; l++) {
+                d.x[l] -= p.x[l];
+                d.y[l] -= p.y[l];
+                d.z[l] -= p.z[l];
+            }
+        }
+    };
+
+    // Where the paths of the lanes first touch a collider, in its own space: hit is 0
+    // or 1, t the fraction of the step, q the contact point and n the outward normal
+    struct Contacts
+    {
+        alignas(64) float hit[lanes] = {};
+        alignas(64) float t[lanes] = {};
+        alignas(64) float qx[lanes] = {};
+        alignas(64) float qy[lanes] = {};
+        alignas(64) float qz[lanes] = {};
+        alignas(64) float nx[lanes] = {};
+        alignas(64) float ny[lanes] = {};
+        alignas(64) float nz[lanes] = {};
+
+        void set(int l, float hit, float t, const float q[3], const float n[3])
+        {
+            this->hit[l] = hit;
+            this->t[l] = t;
+            qx[l] = q[0];
+            qy[l] = q[1];
+            qz[l] = q[2];
+            nx[l] = n[0];
+            ny[l] = n[1];
+            nz[l] = n[2];
+        }
+    };
+
+    /*
+    * Moves every lane of b that hit the collider, moving from s over the step, to where
+    * its path first touched it: the contact point plus the remaining 1 - t of the
+    * point's own motion without its part along the outward normal. The collider pushes
+    * the point but does not drag it sideways. Blends by hit so nothing branches.
+    */
+    void land(const ColliderSet::Frame& frame, const Contacts& c, const PointBlock& s, PointBlock& b)
+    {
+        const Linear w(frame.toWorld);
+        // Normals map by the inverse transpose
+        const Linear m(frame.toLocal);
+        const float cx = frame.center.x(), cy = frame.center.y(), cz = frame.center.z();
+        for (int l = 0; l < lanes; l++) {
+            const float qx = cx + w(0, 0) * c.qx[l] + w(0, 1) * c.qy[l] + w(0, 2) * c.qz[l];
+            const float qy = cy + w(1, 0) * c.qx[l] + w(1, 1) * c.qy[l] + w(1, 2) * c.qz[l];
+            const float qz = cz + w(2, 0) * c.qx[l] + w(2, 1) * c.qy[l] + w(2, 2) * c.qz[l];
+            float nx = m(0, 0) * c.nx[l] + m(1, 0) * c.ny[l] + m(2, 0) * c.nz[l];
+            float ny = m(0, 1) * c.nx[l] + m(1, 1) * c.ny[l] + m(2, 1) * c.nz[l];
+            float nz = m(0, 2) * c.nx[l] + m(1, 2) * c.ny[l] + m(2, 2) * c.nz[l];
+            const float invLen = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz + 1e-30f);
+            nx *= invLen;
+            ny *= invLen;
+            nz *= invLen;
+            const float vx = b.x[l] - s.x[l], vy = b.y[l] - s.y[l], vz = b.z[l] - s.z[l];
+            const float rest = 1.0f - c.t[l];
+            const float normal = vx * nx + vy * ny + vz * nz;
+            b.x[l] += c.hit[l] * (qx + rest * (vx - normal * nx) - b.x[l]);
+            b.y[l] += c.hit[l] * (qy + rest * (vy - normal * ny) - b.y[l]);
+            b.z[l] += c.hit[l] * (qz + rest * (vz - normal * nz) - b.z[l]);
+        }
+    }
+
+    void sweepSphere(const ColliderSet::Sphere& sphere, const PointBlock& s, PointBlock& b)
+    {
+        const LocalPaths r(sphere.frame, s, b);
+        Contacts contacts;
+        const float radius = sphere.radius;
+        const float invRadius = 1.0f / radius;
+        for (int l = 0; l < lanes; l++) {
+            const float px = r.p.x[l], py = r.p.y[l], pz = r.p.z[l];
+            const float dx = r.d.x[l], dy = r.d.y[l], dz = r.d.z[l];
+            // First root of |p + t d| = radius
+            const float a = dx * dx + dy * dy + dz * dz;
+            const float half = px * dx + py * dy + pz * dz;
+            const float c = px * px + py * py + pz * pz - radius * radius;
+            const float disc = half * half - a * c;
+            // |disc| rather than max(disc, 0), which GCC does not vectorize here, as lanes
+            // with a negative disc miss anyway
+            const float t = (-half - std::sqrt(std::abs(disc))) / (a + 1e-30f);
+            // Starts outside, moves inwards and reaches the surface within the step
+            const float hit = (float)((c > 0.0f) & (half < 0.0f) & (disc >= 0.0f) & (t <= 1.0f));
+            const float tc = clamp01(t);
+            const float q[3] = {px + tc * dx, py + tc * dy, pz + tc * dz};
+            const float n[3] = {q[0] * invRadius, q[1] * invRadius, q[2] * invRadius};
+            // Leave points that end inside on the side they entered to resolveSphere()
+            const float ex = px + dx, ey = py + dy, ez = pz + dz;
+            const float nearSide = (float)((ex * ex + ey * ey + ez * ez < radius * radius) &
+                                           (ex * n[0] + ey * n[1] + ez * n[2] > 0.0f));
+            contacts.set(l, hit * (1.0f - nearSide), tc, q, n);
+        }
+        land(sphere.frame, contacts, s, b);
+    }
+
+    void sweepBox(const ColliderSet::Box& box, const PointBlock& s, PointBlock& b)
+    {
+        const LocalPaths r(box.frame, s, b);
+        Contacts contacts;
+        const Vector3f& h = box.halfSize;
+        for (int l = 0; l < lanes; l++) {
+            const float px = r.p.x[l], py = r.p.y[l], pz = r.p.z[l];
+            const float dx = r.d.x[l], dy = r.d.y[l], dz = r.d.z[l];
+            // Slab test, with motion along an axis kept away from 0 so nothing divides by it
+            const float ix = 1.0f / std::copysign(std::max(std::abs(dx), 1e-20f), dx);
+            const float iy = 1.0f / std::copysign(std::max(std::abs(dy), 1e-20f), dy);
+            const float iz = 1.0f / std::copysign(std::max(std::abs(dz), 1e-20f), dz);
+            const float ax = (-h.x() - px) * ix, bx = (h.x() - px) * ix;
+            const float ay = (-h.y() - py) * iy, by = (h.y() - py) * iy;
+            const float az = (-h.z() - pz) * iz, bz = (h.z() - pz) * iz;
+            const float nearX = std::min(ax, bx), nearY = std::min(ay, by), nearZ = std::min(az, bz);
+            const float enter = std::max(std::max(nearX, nearY), nearZ);
+            const float exit = std::min(std::min(std::max(ax, bx), std::max(ay, by)), std::max(az, bz));
+            const float outside = (float)((std::abs(px) >= h.x()) | (std::abs(py) >= h.y()) | (std::abs(pz) >= h.z()));
+            const float hit = outside * (float)((enter <= exit) & (enter >= 0.0f) & (enter <= 1.0f));
+            // The face entered last is the one hit, ties go to the first axis
+            const float pickX = (float)((nearX >= nearY) & (nearX >= nearZ));
+            const float pickY = (float)((nearY > nearX) & (nearY >= nearZ));
+            const float pickZ = (float)((nearZ > nearX) & (nearZ > nearY));
+            const float tc = clamp01(enter);
+            const float q[3] = {px + tc * dx, py + tc * dy, pz + tc * dz};
+            const float n[3] = {std::copysign(pickX, q[0]), std::copysign(pickY, q[1]), std::copysign(pickZ, q[2])};
+            // Leave points that end inside and leave through the face they entered to resolveBox()
+            const float ex = px + dx, ey = py + dy, ez = pz + dz;
+            const float gx = h.x() - std::abs(ex), gy = h.y() - std::abs(ey), gz = h.z() - std::abs(ez);
+            const float endInside = (float)((gx > 0.0f) & (gy > 0.0f) & (gz > 0.0f));
+            const float exitX = (float)((gx <= gy) & (gx <= gz));
+            const float exitY = (float)((gy < gx) & (gy <= gz));
+            const float exitZ = (float)((gz < gx) & (gz < gy));
+            const float sameFace = std::copysign(exitX, ex) * n[0] + std::copysign(exitY, ey) * n[1] + std::copysign(exitZ, ez) * n[2];
+            contacts.set(l, hit * (1.0f - endInside * std::max(sameFace, 0.0f)), tc, q, n);
+        }
+        land(box.frame, contacts, s, b);
+    }
+
+    void sweepCapsule(const ColliderSet::Capsule& c, const PointBlock& s, PointBlock& b)
+    {
+        const LocalPaths r(c.frame, s, b);
+        Contacts contacts;
+        // Relative to the end point -halfAxis, so the segment runs from 0 to ab
+        const Vector3f& h = c.halfAxis;
+        const Vector3f ab = 2.0f * h;
+        const float invLen2 = ab.squaredNorm() > 0.0f ? 1.0f / ab.squaredNorm() : 0.0f;
+        const float tolerance = 0.01f * c.radius;
+        alignas(64) float t[lanes] = {};
+        alignas(64) float startGap[lanes];
+        // Step each path forward by its distance to the surface, which cannot overshoot
+        for (int k = 0; k < advanceIterations; k++) {
+            for (int l = 0; l < lanes; l++) {
+                const float qx = r.p.x[l] + h.x() + t[l] * r.d.x[l];
+                const float qy = r.p.y[l] + h.y() + t[l] * r.d.y[l];
+                const float qz = r.p.z[l] + h.z() + t[l] * r.d.z[l];
+                const float along = clamp01((qx * ab.x() + qy * ab.y() + qz * ab.z()) * invLen2);
+                const float ex = qx - along * ab.x();
+                const float ey = qy - along * ab.y();
+                const float ez = qz - along * ab.z();
+                const float gap = std::sqrt(ex * ex + ey * ey + ez * ez) - c.radius;
+                const float len = std::sqrt(r.d.x[l] * r.d.x[l] + r.d.y[l] * r.d.y[l] + r.d.z[l] * r.d.z[l]);
+                t[l] += std::max(gap, 0.0f) / (len + 1e-30f);
+                startGap[l] = k == 0 ? gap : startGap[l];
+            }
+        }
+        for (int l = 0; l < lanes; l++) {
+            const float px = r.p.x[l] + h.x(), py = r.p.y[l] + h.y(), pz = r.p.z[l] + h.z();
+            const float dx = r.d.x[l], dy = r.d.y[l], dz = r.d.z[l];
+            const float tc = clamp01(t[l]);
+            const float qx = px + tc * dx, qy = py + tc * dy, qz = pz + tc * dz;
+            const float along = clamp01((qx * ab.x() + qy * ab.y() + qz * ab.z()) * invLen2);
+            const float ex = qx - along * ab.x();
+            const float ey = qy - along * ab.y();
+            const float ez = qz - along * ab.z();
+            const float dist = std::sqrt(ex * ex + ey * ey + ez * ez + 1e-30f);
+            // Started outside and came within the tolerance of the surface inside the step
+            const float hit = (float)((startGap[l] > 0.0f) & (dist - c.radius <= tolerance) & (t[l] <= 1.0f));
+            const float q[3] = {qx - h.x(), qy - h.y(), qz - h.z()};
+            const float n[3] = {ex / dist, ey / dist, ez / dist};
+            // Leave points that end inside on the side they entered to resolveCapsule()
+            const float fx = px + dx, fy = py + dy, fz = pz + dz;
+            const float endAlong = clamp01((fx * ab.x() + fy * ab.y() + fz * ab.z()) * invLen2);
+            const float gx = fx - endAlong * ab.x(), gy = fy - endAlong * ab.y(), gz = fz - endAlong * ab.z();
+            const float nearSide = (float)((gx * gx + gy * gy + gz * gz < c.radius * c.radius) &
+                                           (gx * n[0] + gy * n[1] + gz * n[2] > 0.0f));
+            contacts.set(l, hit * (1.0f - nearSide), tc, q, n);
+        }
+        land(c.frame, contacts, s, b);
+    }
+
+    void sweepSDF(const ColliderSet::SDF& sdf, const PointBlock& s, PointBlock& b)
+    {
+        // Field lookups are scalar, so only paths that get close to the surface keep stepping
+        const LocalPaths r(sdf.frame, s, b);
+        Contacts contacts;
+        const SDFCollider& field = *sdf.collider;
+        const float tolerance = 0.05f * field.cellSize;
+        for (int l = 0; l < lanes; l++) {
+            const Vector3f p(r.p.x[l], r.p.y[l], r.p.z[l]);
+            const Vector3f d(r.d.x[l], r.d.y[l], r.d.z[l]);
+            const float len = d.norm();
+            Vector3f normal;
+            float gap = field.LocalDistance(p, normal);
+            if (gap <= 0.0f || len == 0.0f) {
+                continue;
+            }
+            float t = 0.0f;
+            for (int k = 0; k < advanceIterations && gap > tolerance && t <= 1.0f; k++) {
+                t += gap / len;
+                gap = field.LocalDistance(p + std::min(t, 1.0f) * d, normal);
+            }
+            // Points that end inside on the side they entered are left to resolveSDF()
+            Vector3f endNormal;
+            const bool nearSide = field.LocalDistance(p + d, endNormal) < 0.0f && endNormal.dot(normal) > 0.0f;
+            if (gap <= tolerance && t <= 1.0f && normal != Vector3f::Zero() && !nearSide) {
+                const Vector3f qv = p + t * d;
+                const float q[3] = {qv.x(), qv.y(), qv.z()};
+                const float n[3] = {normal.x(), normal.y(), normal.z()};
+                contacts.set(l, 1.0f, t, q, n);
+            }
+        }
+        land(sdf.frame, contacts, s, b);
+    }
+
+    bool sphereContains(const ColliderSet::Sphere& s, const PointBlock& b)
+    {
+        const LocalBlock p(b, s.frame.center, s.frame.toLocal);
+        int inside = 0;
+        for (int l = 0; l < lanes; l++) {
+            inside |= p.x[l] * p.x[l] + p.y[l] * p.y[l] + p.z[l] * p.z[l] < s.radius * s.radius;
+        }
+        return inside != 0;
+    }
+
+    bool boxContains(const ColliderSet::Box& box, const PointBlock& b)
+    {
+        const LocalBlock p(b, box.frame.center, box.frame.toLocal);
+        int inside = 0;
+        for (int l = 0; l < lanes; l++) {
+            inside |= (std::abs(p.x[l]) < box.halfSize.x()) &
+                      (std::abs(p.y[l]) < box.halfSize.y()) &
+                      (std::abs(p.z[l]) < box.halfSize.z());
+        }
+        return inside != 0;
+    }
+
+    bool capsuleContains(const ColliderSet::Capsule& c, const PointBlock& b)
+    {
+        const LocalBlock p(b, c.frame.center, c.frame.toLocal);
+        const Vector3f& h = c.halfAxis;
+        const Vector3f ab = 2.0f * h;
+        const float invLen2 = ab.squaredNorm() > 0.0f ? 1.0f / ab.squaredNorm() : 0.0f;
+        int inside = 0;
+        for (int l = 0; l < lanes; l++) {
+            const float ax = p.x[l] + h.x();
+            const float ay = p.y[l] + h.y();
+            const float az = p.z[l] + h.z();
+            const float t = clamp01((ax * ab.x() + ay * ab.y() + az * ab.z()) * invLen2);
+            const float dx = ax - t * ab.x();
+            const float dy = ay - t * ab.y();
+            const float dz = az - t * ab.z();
+            inside |= dx * dx + dy * dy + dz * dz < c.radius * c.radius;
+        }
+        return inside != 0;
+    }
+
+    bool sdfContains(const ColliderSet::SDF& sdf, const PointBlock& b)
+    {
+        const LocalBlock p(b, sdf.frame.center, sdf.frame.toLocal);
+        bool inside = false;
+        for (int l = 0; l < lanes; l++) {
+            Vector3f normal;
+            inside |= sdf.collider->LocalDistance(Vector3f(p.x[l], p.y[l], p.z[l]), normal) < 0.0f;
+        }
+        return inside;
+    }
+}
+
+void ColliderSet::build(const std::vector<std::shared_ptr<SceneObject>>& objects,
+                        const std::vector<Eigen::Vector3f>& centers, const std::vector<Eigen::Vector3f>& motions)
+{
+    spheres.clear();
+    boxes.clear();
+    capsules.clear();
+    sdfs.clear();
+    others.clear();
+    for (size_t i = 0; i < objects.size(); i++) {
+        const Collider* collider = objects[i]->collider.get();
+        if (!collider) {
+            continue;
+        }
+        const Frame frame = {centers.empty() ? collider->center : centers[i], collider->toWorld, collider->toLocal,
+                             motions.empty() ? Vector3f::Zero() : motions[i]};
+        if (const auto* sphere = dynamic_cast<const SphereCollider*>(collider)) {
+            spheres.push_back({frame, sphere->radius});
+        } else if (const auto* box = dynamic_cast<const BoxCollider*>(collider)) {
+            boxes.push_back({frame, box->size / 2.0f});
+        } else if (const auto* capsule = dynamic_cast<const CapsuleCollider*>(collider)) {
+            capsules.push_back({frame, capsule->halfAxis, capsule->radius});
+        } else if (const auto* sdf = dynamic_cast<const SDFCollider*>(collider)) {
+            sdfs.push_back({frame, sdf});
+        } else {
+            others.push_back(collider);
+        }
+    }
+
+    // Bounds at the end of the step, grown to cover where the collider started it
+    lowers.clear();
+    uppers.clear();
+    auto addBounds = [&](const Vector3f& lower, const Vector3f& upper, const Vector3f& motion) {
+        lowers.push_back(lower.cwiseMin(lower - motion));
+        uppers.push_back(upper.cwiseMax(upper - motion));
+    };
+    // World bounds of the box [lower, upper] of a collider's own space
+    auto addFrameBounds = [&](const Frame& frame, const Vector3f& lower, const Vector3f& upper) {
+        const Vector3f mid = frame.center + frame.toWorld * ((lower + upper) / 2.0f);
+        const Vector3f half = frame.toWorld.cwiseAbs() * ((upper - lower) / 2.0f);
+        addBounds(mid - half, mid + half, frame.motion);
+    };
+    for (const Sphere& s : spheres) {
+        addFrameBounds(s.frame, Vector3f::Constant(-s.radius), Vector3f::Constant(s.radius));
+    }
+    for (const Box& b : boxes) {
+        addFrameBounds(b.frame, -b.halfSize, b.halfSize);
+    }
+    for (const Capsule& c : capsules) {
+        const Vector3f extent = c.halfAxis.cwiseAbs().array() + c.radius;
+        addFrameBounds(c.frame, -extent, extent);
+    }
+    for (const SDF& sdf : sdfs) {
+        const SDFCollider& field = *sdf.collider;
+        addFrameBounds(sdf.frame, field.origin, field.origin + field.cellSize * (field.dims.array() - 1).cast<float>().matrix());
+    }
+    for (const Collider* c : others) {
+        Vector3f lower, upper;
+        c->GetBounds(lower, upper);
+        addBounds(lower, upper, Vector3f::Zero());
+    }
+}
+
+bool ColliderSet::empty() const
+{
+    return lowers.empty();
+}
+
+void ColliderSet::resolvePoints(Eigen::Vector3f* points, size_t count) const
+{
+    if (empty()) {
+        return;
+    }
+    for (size_t first = 0; first < count; first += blockSize) {
+        resolveBlock(nullptr, points + first, (int)std::min(count - first, (size_t)blockSize));
+    }
+}
+
+void ColliderSet::resolveMotion(const Eigen::Vector3f* starts, Eigen::Vector3f* ends, size_t count) const
+{
+    if (empty()) {
+        return;
+    }
+    for (size_t first = 0; first < count; first += blockSize) {
+        resolveBlock(continuous ? starts + first : nullptr, ends + first, (int)std::min(count - first, (size_t)blockSize));
+    }
+}
+
+bool ColliderSet::overlaps(size_t collider, const Eigen::Vector3f& lower, const Eigen::Vector3f& upper) const
+{
+    return !((lowers[collider].array() > upper.array()).any() || (uppers[collider].array() < lower.array()).any());
+}
+
+void ColliderSet::resolveBlock(const Eigen::Vector3f* starts, Eigen::Vector3f* points, int count) const
+{
+    PointBlock block(points, count);
+    // Without starts the points did not move, and the sweeps are skipped
+    const PointBlock start = starts ? PointBlock(starts, count) : block;
+    const Vector3f lower = block.lower.cwiseMin(start.lower);
+    const Vector3f upper = block.upper.cwiseMax(start.upper);
+    auto overlaps = [&](size_t c) { return this->overlaps(c, lower, upper); };
+    size_t c = 0;
+    for (const Sphere& s : spheres) {
+        if (overlaps(c++)) {
+            if (starts) sweepSphere(s, start, block);
+            resolveSphere(s, block);
+        }
+    }
+    for (const Box& b : boxes) {
+        if (overlaps(c++)) {
+            if (starts) sweepBox(b, start, block);
+            resolveBox(b, block);
+        }
+    }
+    for (const Capsule& cap : capsules) {
+        if (overlaps(c++)) {
+            if (starts) sweepCapsule(cap, start, block);
+            resolveCapsule(cap, block);
+        }
+    }
+    for (const SDF& sdf : sdfs) {
+        if (overlaps(c++)) {
+            if (starts) sweepSDF(sdf, start, block);
+            resolveSDF(sdf, block);
+        }
+    }
+    block.store(points, count);
+    for (const Collider* other : others) {
+        if (overlaps(c++)) other->ResolvePoints(points, count);
+    }
+}
+
+bool ColliderSet::anyInside(const Eigen::Vector3f* points, size_t count) const
+{
+    if (empty()) {
+        return false;
+    }
+    for (size_t first = 0; first < count; first += blockSize) {
+        const int n = (int)std::min(count - first, (size_t)blockSize);
+        const PointBlock block(points + first, n);
+        auto overlaps = [&](size_t c) { return this->overlaps(c, block.lower, block.upper); };
+        size_t c = 0;
+        for (const Sphere& s : spheres) {
+            if (overlaps(c++) && sphereContains(s, block)) return true;
+        }
+        for (const Box& b : boxes) {
+            if (overlaps(c++) && boxContains(b, block)) return true;
+        }
+        for (const Capsule& cap : capsules) {
+            if (overlaps(c++) && capsuleContains(cap, block)) return true;
+        }
+        for (const SDF& sdf : sdfs) {
+            if (overlaps(c++) && sdfContains(sdf, block)) return true;
+        }
+        for (const Collider* other : others) {
+            if (overlaps(c++) && other->AnyInside(points + first, n)) return true;
+        }
+    }
+    return false;
+}
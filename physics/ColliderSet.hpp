@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Collider.hpp>
+#include <memory>
+#include <vector>
+
+struct SceneObject;
+class SDFCollider;
+
+// The colliders of a set of scene objects, copied by type into contiguous arrays.
+// Queries run one loop per type over blocks of points held as separate x, y and z
+// lanes, so the innermost loops have no virtual calls or pointer chasing and
+// compile to SIMD. Rebuild the set whenever the colliders change.
+class ColliderSet
+{
+public:
+    // Points are corrected in blocks of this many lanes
+    static constexpr int blockSize = 16;
+
+    // Where a collider is packed for the step: a point p of its own space is at
+    // center + toWorld * p at the end of the step, after center moved by motion
+    struct Frame
+    {
+        Eigen::Vector3f center;
+        Eigen::Matrix3f toWorld;
+        Eigen::Matrix3f toLocal;
+        Eigen::Vector3f motion;
+    };
+    // Parameters are in the collider's own space. Queries map each block of points into
+    // it once, so an oriented or scaled collider costs the same as an axis-aligned one.
+    struct Sphere
+    {
+        Frame frame;
+        float radius;
+    };
+    struct Box
+    {
+        Frame frame;
+        Eigen::Vector3f halfSize;
+    };
+    struct Capsule
+    {
+        Frame frame;
+        // The segment runs from -halfAxis to halfAxis
+        Eigen::Vector3f halfAxis;
+        float radius;
+    };
+    struct SDF
+    {
+        Frame frame;
+        // Owned by the scene object the set was built from
+        const SDFCollider* collider;
+    };
+
+    /*
+    * Packs the colliders of objects by type. With no centers every collider is packed
+    * at rest where it is, otherwise the collider of objects[i] is packed at centers[i]
+    * after moving by motions[i] over the step. Rotation and scale are the collider's
+    * current ones.
+    */
+    void build(const std::vector<std::shared_ptr<SceneObject>>& objects,
+               const std::vector<Eigen::Vector3f>& centers = {}, const std::vector<Eigen::Vector3f>& motions = {});
+    // Moves every point inside a collider to the closest point on its surface.
+    // Colliders that do not overlap the bounds of a block of points are skipped.
+    void resolvePoints(Eigen::Vector3f* points, size_t count) const;
+    /*
+    * Like resolvePoints() for points that moved from starts to ends over the step. With
+    * continuous set, a point whose path enters a collider, relative to the collider's own
+    * motion, is first carried to where it hits the surface and keeps only the part of
+    * its own remaining motion along it, so neither fast hair nor a fast collider
+    * tunnels through the other. Colliders of other types only test the end points.
+    */
+    void resolveMotion(const Eigen::Vector3f* starts, Eigen::Vector3f* ends, size_t count) const;
+    // Returns true if any of the points is inside a collider
+    bool anyInside(const Eigen::Vector3f* points, size_t count) const;
+    bool empty() const;
+
+    // Whether resolveMotion() tests the paths of points, or only where they end
+    bool continuous = true;
+
+    std::vector<Sphere> spheres;
+    std::vector<Box> boxes;
+    std::vector<Capsule> capsules;
+    std::vector<SDF> sdfs;
+    // Colliders of any other type, at rest and queried through Collider::ResolvePoints
+    std::vector<const Collider*> others;
+
+private:
+    // Corrects up to blockSize points, sweeping them from starts if it is not null
+    void resolveBlock(const Eigen::Vector3f* starts, Eigen::Vector3f* points, int count) const;
+    // Whether the bounds of the given collider overlap [lower, upper]
+    bool overlaps(size_t collider, const Eigen::Vector3f& lower, const Eigen::Vector3f& upper) const;
+
+    // Bounds of each collider over the whole step, in the order of spheres, boxes,
+    // capsules, sdfs, then others
+    std::vector<Eigen::Vector3f> lowers;
+    std::vector<Eigen::Vector3f> uppers;
+};
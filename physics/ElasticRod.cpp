@@ -1,29 +1,60 @@
 #include <ElasticRod.hpp>
+#include <algorithm>
 
 // Elastic rod sim constants
-float ElasticRod::drag = 75.0f;
-float ElasticRod::inextensibility = 0.1f;
-float ElasticRod::alpha = 0.1f;
-float ElasticRod::friction = 0.05;
-float ElasticRod::sampledVelocityScale = 50.0f;
-Vector3f ElasticRod::gravity = {0.0f, -9.8f, 0.0f};
+float ElasticRodBase::drag = 75.0f;
+float ElasticRodBase::inextensibility = 0.1f;
+float ElasticRodBase::alpha = 0.1f;
+float ElasticRodBase::beta = 1.0f;
+bool ElasticRodBase::quasiStaticTwist = true;
+int ElasticRodBase::twistIterations = 3;
+float ElasticRodBase::stretchStiffness = 1e5f;
+int ElasticRodBase::xpbdIterations = 4;
+float ElasticRodBase::bendCompliance = 1e-6f;
+float ElasticRodBase::ftlDamping = 0.9f;
+float ElasticRodBase::friction = 0.05;
+float ElasticRodBase::sampledVelocityScale = 50.0f;
+float ElasticRodBase::volumeStiffness = 0.05f;
+float ElasticRodBase::restDensity = 4.0f;
+bool ElasticRodBase::allowSleep = true;
+float ElasticRodBase::sleepSpeed = 0.002f;
+float ElasticRodBase::sleepCorrection = 0.01f;
+int ElasticRodBase::sleepSteps = 60;
+Vector3f ElasticRodBase::gravity = {0.0f, -9.8f, 0.0f};
+
+namespace
+{
+    // Sizes runtime storage to n copies of value, fixed storage is only refilled
+    template <typename Storage>
+    void resizeStorage(Storage& a, size_t n, const typename Storage::value_type& value)
+    {
+        if constexpr (std::is_same_v<Storage, std::vector<typename Storage::value_type>>) {
+            a.assign(n, value);
+        } else {
+            assert(n == a.size());
+            a.fill(value);
+        }
+    }
+}
 
-Vector3f ElasticRod::kappaB(int i)
+template <int N>
+const Vector3f& ElasticRod<N>::kappaB(int i)
 {
-    return (2.0f * edge(i-1).cross(edge(i))) /
-           (initEdge(i).norm() * initEdge(i-1).norm() + edge(i-1).dot(edge(i)));
+    return kbs[i];
 }
 
-float ElasticRod::initEdgeLen(int i)
+template <int N>
+float ElasticRod<N>::initEdgeLen(int i)
 {
-    i = std::clamp(i, 0, (int)(xRest.size() - 2));
-    return (xRest[i + 1] - xRest[i]).norm();
+    assert(i >= -1 && i < numVerts());
+    return restEdgeLens[i + 1];
 }
 
-Vector3f ElasticRod::psiGrad(int i, int j)
+template <int N>
+Vector3f ElasticRod<N>::psiGrad(int i, int j)
 {
     assert(j >= i-1 && j <= i+1);
-    const Vector3f kb = kappaB(i);
+    const Vector3f& kb = kappaB(i);
     if (j == i - 1)
     {
         return kb / (2.0f * initEdgeLen(i - 1));
@@ -35,90 +66,137 @@ Vector3f ElasticRod::psiGrad(int i, int j)
     return -kb / (2.0f * initEdgeLen(i - 1)) - kb / (2.0f * initEdgeLen(i));
 }
 
-Matrix3f ElasticRod::kappaBGrad(int i, int j)
+template <int N>
+Matrix3f ElasticRod<N>::kappaBGrad(int i, int j)
 {
     assert(j >= i-1 && j <= i+1);
-    const Vector3f kb = kappaB(i);
-    const float denom = initEdge(i-1).norm() * initEdge(i).norm() + edge(i-1).dot(edge(i));
+    const Vector3f& kb = kappaB(i);
+    const float denom = kbDenoms[i];
+    const std::array<Vector3f, 2u>& denomGrads = kbDenomGrads[i];
     if (j == i - 1) {
-        return (2.0f * skew(edge(i)) + kb * edge(i).transpose()) / denom;
+        return (2.0f * skew(edge(i)) + kb * denomGrads[0].transpose()) / denom;
     }
     else if (j == i + 1) {
-        return (2.0f * skew(edge(i-1)) - kb * edge(i-1).transpose()) / denom;
+        return (2.0f * skew(edge(i-1)) - kb * denomGrads[1].transpose()) / denom;
     }
-    return -((2.0f * skew(edge(i)) + kb * edge(i).transpose()) +
-        (2.0f * skew(edge(i-1)) - kb * edge(i-1).transpose())) /
+    return -((2.0f * skew(edge(i)) + kb * denomGrads[0].transpose()) +
+        (2.0f * skew(edge(i-1)) - kb * denomGrads[1].transpose())) /
         denom;
 }
 
-Vector2f ElasticRod::omega(int i, int j) {
+template <int N>
+Vector2f ElasticRod<N>::omega(int i, int j) {
     assert(j == i-1 || j == i);
-    j = std::clamp(j, 0, (int)(x.size() - 1));
-    const Vector3f kb = kappaB(i);
+    assert(j >= 0);
+    const Vector3f& kb = kappaB(i);
     return {kb.dot(M[j].m2), -kb.dot(M[j].m1)};
 }
 
 const Matrix2f J = Rotation2Df(pi / 2.0f).matrix();
 
-Matrix<float, 2, 3> ElasticRod::omegaGrad(int i, int j, int k)
+template <int N>
+void ElasticRod<N>::compForces(bool assembleHessian)
 {
-    Matrix<float, 2, 3> m;
-    m.setZero();
-    if (k >= i-1 && k <= i+1) {
-        m.row(0) = M[j].m2;
-        m.row(1) = -M[j].m1;
-        m *= kappaBGrad(i, k);
+    const int n = (int)x.size();
+    std::fill(forces.begin(), forces.end(), Vector3f::Zero());
+    std::fill(holonomyWeights.begin(), holonomyWeights.end(), 0.0f);
+    if (assembleHessian) {
+        std::fill(systemBand.begin(), systemBand.end(), 0.0f);
+        std::fill(hessianV.begin(), hessianV.end(), Vector3f::Zero());
     }
-    return m - J * omega(k, j) * gradHolonomy(i, j).transpose();
-}
 
-Vector3f ElasticRod::gradHolonomy(int i, int j)
-{
-    Vector3f gh = Vector3f::Zero();
-    if (j >= i-1 && i > 1 && i-1 < x.size()) {
-        gh += gradHolonomyTerms[i-1][2];
+    // Each bending element k only touches x[k-1], x[k] and x[k+1] through its
+    // curvature binormal, so scatter its local gradient straight into those.
+    for (int k = 1; k < n; k++) {
+        const float invLen = 1.0f / initEdgeLen(k);
+        const std::array<Matrix3f, 3> kbGrad = {
+            kappaBGrad(k, k - 1), kappaBGrad(k, k), kappaBGrad(k, k + 1)
+        };
+        for (int j = k - 1; j <= k; j++) {
+            const Vector2f w = omega(k, j);
+            const Vector2f dw = B * (w - omega0[k][j - k + 1]) * invLen;
+            Matrix<float, 2, 3> m;
+            m.row(0) = M[j].m2;
+            m.row(1) = -M[j].m1;
+            std::array<Matrix<float, 2, 3>, 3> wGrad;
+            for (int l = 0; l < 3; l++) {
+                wGrad[l] = m * kbGrad[l];
+                const int i = k - 1 + l;
+                if (i >= 1 && i < n) {
+                    forces[i] -= wGrad[l].transpose() * dw;
+                }
+            }
+            holonomyWeights[j] += (J * w).dot(dw);
+
+            if (!assembleHessian) {
+                continue;
+            }
+            // Gauss-Newton term dw/dx^T B dw/dx, the frame and holonomy
+            // derivatives are dropped so every block stays symmetric PSD
+            for (int a = 0; a < 3; a++) {
+                const Matrix<float, 3, 2> gB = wGrad[a].transpose() * B * invLen;
+                for (int b = 0; b < 3; b++) {
+                    addHessianBlock(k - 1 + a, k - 1 + b, gB * wGrad[b]);
+                }
+            }
+        }
     }
-    if (j >= i && i < x.size()) {
-        gh += gradHolonomyTerms[i][1];
+
+    // The holonomy gradient of frame j reaches every vertex up to j+1, so it
+    // is applied through suffix sums of the per-frame weights instead.
+    float suffix = 0.0f;
+    for (int i = n - 1; i >= 0; i--) {
+        suffix += holonomyWeights[i];
+        holonomyWeights[i] = suffix;
     }
-    if (j >= i+1 && i+1 < x.size()) {
-        gh += gradHolonomyTerms[i+1][0];
+    for (int i = 1; i < n; i++) {
+        if (i > 1) {
+            forces[i] += gradHolonomyTerms[i-1][2] * holonomyWeights[i-1];
+        }
+        forces[i] += gradHolonomyTerms[i][1] * holonomyWeights[i];
+        if (i + 1 < n) {
+            forces[i] += gradHolonomyTerms[i+1][0] * holonomyWeights[i+1];
+        }
     }
-    return gh;
 }
 
-Vector3f ElasticRod::dEdX(int i)
+template <int N>
+void ElasticRod<N>::addHessianBlock(int ia, int ib, const Matrix3f& h)
 {
-    Vector3f f = Vector3f::Zero();
-    for (int k = 1; k < x.size(); k++) {
-        Vector3f pf = Vector3f::Zero();
-        for (int j = k-1; j <= k; j++) {
-            pf += omegaGrad(i, j, k).transpose() * B * (omega(k, j) - omega0[k][k-j]);
+    // The root is fixed, and i + 1 == n comes from the last element
+    if (ia < 1 || ib < 1 || ia >= numVerts() || ib >= numVerts()) {
+        return;
+    }
+    hessianV[ia] += h * v[ib];
+    if (ib > ia) {
+        return;
+    }
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3 && (ib < ia || c <= r); c++) {
+            banded::at<hessianBandwidth>(systemBand.data(), 3 * ia + r, 3 * ib + c) += h(r, c);
         }
-        f += pf / initEdgeLen(k);
     }
-    return -f;
 }
 
-void ElasticRod::compBishopFrames()
+template <int N>
+void ElasticRod<N>::compBishopFrames()
 {
-    bishopFrames[0] = {u0, edge(0).cross(u0).normalized()};
+    // Carry the root frame along with edge 0 since the last update, then
+    // renormalize so rounding does not build up across steps
+    const Vector3f t0 = edge(0) / edgeLen(0);
+    u0 = parallelTransport(rootEdge, rootEdge.norm(), edge(0), edgeLen(0), u0);
+    u0 = (u0 - t0 * t0.dot(u0)).normalized();
+    rootEdge = edge(0);
+
+    bishopFrames[0] = {u0, t0.cross(u0)};
     for (int i = 1; i < x.size(); i++) {
-        float d = edge(i).dot(edge(i-1));
-        float cosTheta = d / (edge(i).norm() * edge(i-1).norm());
-        if (std::abs(cosTheta) < 1e-6 || cosTheta > 1.0f - 1e-6) {
-            bishopFrames[i] = bishopFrames[i-1];
-        } else {
-            float angle = std::acos(cosTheta);
-            assert(!std::isnan(angle));
-            Vector3f u = AngleAxisf(angle, kappaB(i)) * bishopFrames[i-1].u;
-            Vector3f v = edge(i).normalized().cross(u).normalized();
-            bishopFrames[i] = {u, v};
-        }
+        const Vector3f u = parallelTransportFrame(i, bishopFrames[i-1].u);
+        bishopFrames[i] = {u, (edge(i) / edgeLen(i)).cross(u)};
     }
 }
 
-void ElasticRod::compMatFrames()
+template <int N>
+void ElasticRod<N>::compMatFrames()
 {
     for (int i = 0; i < x.size() - 1; i++) {
         M[i] = {
@@ -128,7 +206,68 @@ void ElasticRod::compMatFrames()
     }
 }
 
-void ElasticRod::compGradHolonomyTerms()
+template <int N>
+void ElasticRod<N>::updateTwist()
+{
+    const int n = numVerts();
+    // theta[0] is clamped at the root, the free angles are theta[1..n-2]
+    if (n < 3) {
+        return;
+    }
+    for (int it = 0; it < twistIterations; it++) {
+        compMatFrames();
+        for (int j = 1; j < n - 1; j++) {
+            float grad = 0.0f;
+            float diag = 0.0f;
+            // Frame j enters bending elements j and j + 1, with dw/dtheta = -J w
+            for (int k = j; k <= j + 1; k++) {
+                const Vector2f w = omega(k, j);
+                const Vector2f dw = w - omega0[k][j - k + 1];
+                const Vector2f jw = J * w;
+                const float invLen = 1.0f / initEdgeLen(k);
+                grad -= jw.dot(B * dw) * invLen;
+                diag += std::max(jw.dot(B * jw) - dw.dot(B * w), 0.0f) * invLen;
+            }
+            // Twist energy beta m_i^2 / l_i, with m_i = theta[i] - theta[i-1] as
+            // the Bishop frames carry no twist of their own
+            const float c0 = 2.0f * beta / (initEdgeLen(j - 1) + initEdgeLen(j));
+            grad += c0 * (theta[j] - theta[j - 1]);
+            diag += c0;
+            twistOff[j] = 0.0f;
+            if (j + 1 < n - 1) {
+                const float c1 = 2.0f * beta / (initEdgeLen(j) + initEdgeLen(j + 1));
+                grad -= c1 * (theta[j + 1] - theta[j]);
+                diag += c1;
+                twistOff[j] = -c1;
+            }
+            twistDiag[j] = diag;
+            twistRhs[j] = grad;
+        }
+
+        // Thomas algorithm, the system is diagonally dominant so no pivoting
+        for (int j = 2; j < n - 1; j++) {
+            const float m = twistOff[j - 1] / twistDiag[j - 1];
+            twistDiag[j] -= m * twistOff[j - 1];
+            twistRhs[j] -= m * twistRhs[j - 1];
+        }
+        float maxStep = 0.0f;
+        for (int j = n - 2; j >= 1; j--) {
+            if (j + 1 < n - 1) {
+                twistRhs[j] -= twistOff[j] * twistRhs[j + 1];
+            }
+            twistRhs[j] /= twistDiag[j];
+            theta[j] -= twistRhs[j];
+            maxStep = std::max(maxStep, std::abs(twistRhs[j]));
+        }
+        assert(!std::isnan(maxStep));
+        if (maxStep < 1e-6f) {
+            break;
+        }
+    }
+}
+
+template <int N>
+void ElasticRod<N>::compGradHolonomyTerms()
 {
     for (int i = 0; i < x.size(); i++) {
         for (int j = 0; j < 3; j++) {
@@ -137,79 +276,178 @@ void ElasticRod::compGradHolonomyTerms()
     }
 }
 
-Vector3f ElasticRod::parallelTransportFrame(int i, const Vector3f& u) {
-    const Vector3f e0 = edge(i-1);
-    const Vector3f e1 = edge(i);
-    Vector3f axis = (2.0f * e0.cross(e1)) / (e0.norm() * e1.norm() + e0.dot(e1));
-    
-    float magnitude = axis.dot(axis);
-    float cosPhi = std::sqrt(4.0f / (4.0f + magnitude));
-    float sinPhi = std::sqrt(magnitude / (4.0f + magnitude));
-    assert(cosPhi >= 0.0f && cosPhi <= 1.0f);
-
-    if (1.0f - cosPhi < 1e-6f) {
-        return e1.cross(u).cross(e1).normalized();
+template <int N>
+Vector3f ElasticRod<N>::parallelTransport(const Vector3f& e0, float len0, const Vector3f& e1, float len1, const Vector3f& u)
+{
+    const float denom = len0 * len1 + e0.dot(e1);
+    // Opposite edges have no unique minimal rotation, drop u onto the new normal plane
+    if (denom <= 1e-6f * len0 * len1) {
+        return (u - e1 * (e1.dot(u) / (len1 * len1))).normalized();
     }
-    Quaternionf q({cosPhi, sinPhi * axis.normalized()});
-    Quaternionf p({0.0f, u});
-    Quaternionf r = q * p * q.conjugate();
-    return {r.y(), r.z(), r.w()};
+    // axis = 2 tan(phi/2) n, so the rotation quaternion is (2, axis) / sqrt(4 + |axis|^2)
+    const Vector3f axis = (2.0f * e0.cross(e1)) / denom;
+    const float s = 1.0f / std::sqrt(4.0f + axis.squaredNorm());
+    const float w = 2.0f * s;
+    const Vector3f q = axis * s;
+    const Vector3f t = 2.0f * q.cross(u);
+    return u + w * t + q.cross(t);
+}
+
+template <int N>
+Vector3f ElasticRod<N>::parallelTransportFrame(int i, const Vector3f& u) {
+    return parallelTransport(edge(i-1), edgeLen(i-1), edge(i), edgeLen(i), u);
 }
 
-Vector3f ElasticRod::edge(int i)
+template <int N>
+const Vector3f& ElasticRod<N>::edge(int i)
 {
-    i = std::clamp(i, 0, (int)(x.size() - 2));
-    return x[i + 1] - x[i];
+    assert(i >= -1 && i < numVerts());
+    return edges[i + 1];
 }
 
-Vector3f ElasticRod::initEdge(int i)
+template <int N>
+float ElasticRod<N>::edgeLen(int i)
 {
-    i = std::clamp(i, 0, (int)(x.size() - 2));
-    return xRest[i + 1] - xRest[i];
+    assert(i >= -1 && i < numVerts());
+    return edgeLens[i + 1];
 }
 
-Vector3f ElasticRod::force(int i)
+template <int N>
+void ElasticRod<N>::compGeometry()
+{
+    const int n = numVerts();
+    for (int i = 0; i < n - 1; i++) {
+        edges[i + 1] = x[i + 1] - x[i];
+        edgeLens[i + 1] = edges[i + 1].norm();
+    }
+    edges[0] = edges[1];
+    edgeLens[0] = edgeLens[1];
+    edges[n] = edges[n - 1];
+    edgeLens[n] = edgeLens[n - 1];
+    for (int i = 0; i < n; i++) {
+        const Vector3f& e0 = edge(i-1);
+        const Vector3f& e1 = edge(i);
+        // Contacts that carry a vertex far within one step leave its edges stretched,
+        // where the rest lengths alone let the curvature grow without bound and a fold
+        // divides by zero, so the current lengths take over once they are longer. The
+        // denominator gradients follow whichever branch is active, so the forces stay
+        // the gradient of the bending energy.
+        const float lens = edgeLen(i-1) * edgeLen(i);
+        if (restKbDenoms[i] < lens) {
+            kbDenoms[i] = lens + e0.dot(e1);
+            kbDenomGrads[i] = {e1 + e0 * (edgeLen(i) / edgeLen(i-1)), e0 + e1 * (edgeLen(i-1) / edgeLen(i))};
+        } else {
+            kbDenoms[i] = restKbDenoms[i] + e0.dot(e1);
+            kbDenomGrads[i] = {e1, e0};
+        }
+        if (kbDenoms[i] < 0.1f * restKbDenoms[i]) {
+            kbDenoms[i] = 0.1f * restKbDenoms[i];
+            kbDenomGrads[i] = {Vector3f::Zero(), Vector3f::Zero()};
+        }
+        kbs[i] = (2.0f * e0.cross(e1)) / kbDenoms[i];
+    }
+}
+
+template <int N>
+Vector3f ElasticRod<N>::force(int i)
 {
     assert(i >= 1);
-    return dEdX(i);
+    return forces[i];
 }
 
-void ElasticRod::init(const std::vector<glm::vec3> &verts)
+template <int N>
+void ElasticRod<N>::init(const std::vector<glm::vec3> &verts)
 {
-    x.resize(verts.size(), Vector3f::Zero());
-    v.resize(verts.size(), Vector3f::Zero());
-    gradHolonomyTerms.resize(verts.size());
-    theta.resize(verts.size(), 0.0f);
-    xUnconstrained.resize(verts.size(), Vector3f::Zero());
-    correctionVecs.resize(verts.size(), Vector3f::Zero());
-    omega0.resize(verts.size());
-    bishopFrames.resize(verts.size());
-    M.resize(verts.size());
+    const size_t n = verts.size();
+    assert(n >= 2);
+    resizeStorage(x, n, Vector3f::Zero());
+    resizeStorage(v, n, Vector3f::Zero());
+    resizeStorage(gradHolonomyTerms, n, {Vector3f::Zero(), Vector3f::Zero(), Vector3f::Zero()});
+    resizeStorage(forces, n, Vector3f::Zero());
+    resizeStorage(holonomyWeights, n, 0.0f);
+    resizeStorage(theta, n, 0.0f);
+    resizeStorage(twistDiag, n, 0.0f);
+    resizeStorage(twistOff, n, 0.0f);
+    resizeStorage(twistRhs, n, 0.0f);
+    resizeStorage(xUnconstrained, n, Vector3f::Zero());
+    resizeStorage(correctionVecs, n, Vector3f::Zero());
+    resizeStorage(omega0, n, {Vector2f::Zero(), Vector2f::Zero()});
+    resizeStorage(bishopFrames, n, {});
+    resizeStorage(M, n, {});
+    resizeStorage(edges, n + 1, Vector3f::Zero());
+    resizeStorage(edgeLens, n + 1, 0.0f);
+    resizeStorage(kbs, n, Vector3f::Zero());
+    resizeStorage(kbDenoms, n, 0.0f);
+    resizeStorage(kbDenomGrads, n, {Vector3f::Zero(), Vector3f::Zero()});
+    resizeStorage(restEdgeLens, n + 1, 0.0f);
+    resizeStorage(restKbDenoms, n, 0.0f);
+    resizeStorage(systemBand, 3 * n * (hessianBandwidth + 1), 0.0f);
+    resizeStorage(deltaV, 3 * n, 0.0f);
+    resizeStorage(hessianV, n, Vector3f::Zero());
+    resizeStorage(restBendLens, n, 0.0f);
+    resizeStorage(sleepVelocities, n, Vector3f::Zero());
+    resizeStorage(sampledVelocities, n, Vector3f::Zero());
+    resizeStorage(sampledDensities, n, 0.0f);
+    resizeStorage(sampledDensityGradients, n, Vector3f::Zero());
+    resizeStorage(bendLambdas, n, 0.0f);
 
     for (int i = 0; i < verts.size(); i++)  {
         x[i] = Vector3f(verts[i].x, verts[i].y, verts[i].z);
     }
     xRest = x;
 
+    // Rest state never changes, so its lengths are computed once here
+    for (int i = 0; i < n - 1; i++) {
+        restEdgeLens[i + 1] = (xRest[i + 1] - xRest[i]).norm();
+    }
+    restEdgeLens[0] = restEdgeLens[1];
+    restEdgeLens[n] = restEdgeLens[n - 1];
+    for (int i = 0; i < verts.size(); i++) {
+        restKbDenoms[i] = initEdgeLen(i-1) * initEdgeLen(i);
+    }
+    for (int i = 1; i < n - 1; i++) {
+        restBendLens[i] = (xRest[i + 1] - xRest[i - 1]).norm();
+    }
+    compGeometry();
+    initRootFrame();
+    compBishopFrames();
+    compMatFrames();
+
     // Compute initial material curvature
     for (int i = 0; i < verts.size(); i++) {
         for (int j = 0; j < 2; j++) {
-            omega0[i][j] = omega(i, i + j-1);
+            omega0[i][j] = omega(i, std::max(i + j-1, 0));
         }
     }
 }
 
-ElasticRod::ElasticRod(const std::vector<glm::vec3> &verts)
+template <int N>
+void ElasticRod<N>::initRootFrame()
+{
+    // Without a root frame every bishop frame, and so every bending force, is
+    // zero. Any vector perpendicular to the rest root edge will do.
+    rootEdge = xRest[1] - xRest[0];
+    u0 = rootEdge.unitOrthogonal();
+}
+
+template <int N>
+ElasticRod<N>::ElasticRod(const std::vector<glm::vec3> &verts)
 {
     init(verts);
 }
 
 
-void ElasticRod::integrateFwEuler(float dt)
+template <int N>
+void ElasticRod<N>::integrateFwEuler(float dt)
 {
+    compGeometry();
     compBishopFrames();
+    if (quasiStaticTwist) {
+        updateTwist();
+    }
     compMatFrames();
     compGradHolonomyTerms();
+    compForces();
 
     xUnconstrained[0] = xRest[0]; // so root position is known
     for (int i = 1; i < x.size(); i++) 
@@ -221,113 +459,325 @@ void ElasticRod::integrateFwEuler(float dt)
     }
 }
 
-void ElasticRod::handleCollisions(const std::vector<std::shared_ptr<SceneObject>>& colliders)
+template <int N>
+void ElasticRod<N>::integrateImplicitEuler(float dt)
 {
-    SphereCollider vertCollider(Eigen::Vector3f(0.0f, 0.0f, 0.0f),1.0f);
-    CollisionInfo collisionInfo;
-    for (int i = 1; i < x.size(); i++) {
-        for (const std::shared_ptr<SceneObject>& c : colliders) {
-            vertCollider.center = xUnconstrained[i];
-            if(c->collider->IsCollidingWith(vertCollider, collisionInfo))     
-                xUnconstrained[i] = c->collider->center - collisionInfo.normal * c->collider->GetBoundaryAt(xUnconstrained[i]);
-        }      
+    compGeometry();
+    compBishopFrames();
+    if (quasiStaticTwist) {
+        updateTwist();
+    }
+    compMatFrames();
+    compGradHolonomyTerms();
+    compForces(true);
+
+    const int n = numVerts();
+    for (int e = 0; e < n - 1; e++) {
+        const Vector3f t = edge(e) / edgeLen(e);
+        const Matrix3f k = stretchStiffness * t * t.transpose();
+        addHessianBlock(e, e, k);
+        addHessianBlock(e + 1, e + 1, k);
+        addHessianBlock(e, e + 1, -k);
+        addHessianBlock(e + 1, e, -k);
+    }
+
+    // Root rows stay identity with a zero right hand side, so its velocity never changes
+    const float dt2 = dt * dt;
+    for (float& a : systemBand) {
+        a *= dt2;
+    }
+    for (int r = 0; r < 3 * n; r++) {
+        banded::at<hessianBandwidth>(systemBand.data(), r, r) += 1.0f;
+    }
+    for (int i = 0; i < n; i++) {
+        const Vector3f rhs = i == 0 ? Vector3f::Zero() : Vector3f((force(i) + gravity - dt * hessianV[i]) * dt);
+        deltaV[3 * i] = rhs.x();
+        deltaV[3 * i + 1] = rhs.y();
+        deltaV[3 * i + 2] = rhs.z();
+    }
+    // I + dt^2 H is SPD by construction, a failed factorization means NaNs came in,
+    // in which case the explicit velocity change is kept
+    if (banded::cholesky<hessianBandwidth>(systemBand.data(), 3 * n)) {
+        banded::solve<hessianBandwidth>(systemBand.data(), 3 * n, deltaV.data());
+    }
+
+    xUnconstrained[0] = xRest[0]; // so root position is known
+    for (int i = 1; i < n; i++)
+    {
+        Eigen::Vector3f vUnconstrained(deltaV[3 * i], deltaV[3 * i + 1], deltaV[3 * i + 2]);
+        assert(!vUnconstrained.hasNaN());
+        // Quadratic drag taken implicitly, |v'| + 0.5 drag dt |v'|^2 = |v| has a closed form
+        // root, where the explicit update overshoots once drag * dt * |v| grows past 1
+        const float k = drag * dt;
+        const float speed = vUnconstrained.norm();
+        if (k * speed > 1e-6f) {
+            vUnconstrained *= (std::sqrt(1.0f + 2.0f * k * speed) - 1.0f) / (k * speed);
+        }
+        xUnconstrained[i] = x[i] +  (vUnconstrained + v[i]) * dt;
     }
 }
 
-void ElasticRod::enforceConstraints(float dt,const std::vector<std::shared_ptr<SceneObject>>& colliders)
+template <int N>
+void ElasticRod<N>::handleCollisions(const ColliderSet& colliders)
+{
+    colliders.resolveMotion(x.data() + 1, xUnconstrained.data() + 1, x.size() - 1);
+}
+
+template <int N>
+void ElasticRod<N>::enforceConstraints(float dt,const ColliderSet& colliders)
 {
     handleCollisions(colliders);
     //set all vs to 0
     for (int i = 0; i < v.size(); i++) {
         v[i] = Vector3f::Zero();
     }
+    lastStepMotion = 0.0f;
+    float kineticEnergy = 0.0f;
+    float maxCorrectionChange = 0.0f;
     for (int i = 1; i < x.size(); i++) {
         Eigen::Vector3f correctedX = xUnconstrained[i] - xUnconstrained[i-1];
         correctedX = xUnconstrained[i-1] + correctedX.normalized() * initEdgeLen(i-1); 
         //v[i] = (correctedX - x[i]) / dt;
+        const Vector3f correctionVec = correctedX - xUnconstrained[i];
+        maxCorrectionChange = std::max(maxCorrectionChange, (correctionVec - correctionVecs[i]).norm() / initEdgeLen(i-1));
+        correctionVecs[i] = correctionVec;
+        lastStepMotion = std::max(lastStepMotion, ((correctedX - x[i]).norm() + correctionVec.norm()) / initEdgeLen(i-1));
+        kineticEnergy += 0.5f * (correctedX - x[i]).squaredNorm() / (dt * dt);
         x[i] = correctedX;
         assert(!x[i].hasNaN());
-        correctionVecs[i] = correctedX - xUnconstrained[i];
     }
     for (int i = 1; i < x.size()-1; i++) {
         v[i] -= -inextensibility * correctionVecs[i+1]/dt;
         assert(!v[i].hasNaN());
     }
+    updateSleep(kineticEnergy, maxCorrectionChange);
 
    
 }
 
+template <int N>
+void ElasticRod<N>::integrateXPBD(float dt, const ColliderSet& colliders)
+{
+    const int n = numVerts();
+    xUnconstrained[0] = xRest[0];
+    for (int i = 1; i < n; i++) {
+        // Same implicit quadratic drag as integrateImplicitEuler
+        Vector3f vPredicted = v[i] + gravity * dt;
+        const float k = drag * dt;
+        const float speed = vPredicted.norm();
+        if (k * speed > 1e-6f) {
+            vPredicted *= (std::sqrt(1.0f + 2.0f * k * speed) - 1.0f) / (k * speed);
+        }
+        xUnconstrained[i] = x[i] + vPredicted * dt;
+    }
+
+    // Free vertices have unit mass and the root is pinned. Distance constraints
+    // are rigid, bending constraints keep x[i-1] and x[i+1] at their rest
+    // distance with the given compliance.
+    const float bendAlpha = bendCompliance / (dt * dt);
+    std::fill(bendLambdas.begin(), bendLambdas.end(), 0.0f);
+    for (int it = 0; it < xpbdIterations; it++) {
+        for (int i = 1; i < n; i++) {
+            const Vector3f d = xUnconstrained[i] - xUnconstrained[i - 1];
+            const float len = d.norm();
+            if (len < 1e-8f) continue;
+            const float wa = i - 1 == 0 ? 0.0f : 1.0f;
+            const Vector3f corr = (initEdgeLen(i - 1) - len) / (wa + 1.0f) * d / len;
+            xUnconstrained[i - 1] -= wa * corr;
+            xUnconstrained[i] += corr;
+        }
+        for (int i = 1; i < n - 1; i++) {
+            const Vector3f d = xUnconstrained[i + 1] - xUnconstrained[i - 1];
+            const float len = d.norm();
+            if (len < 1e-8f) continue;
+            const float wa = i - 1 == 0 ? 0.0f : 1.0f;
+            const float dLambda = (restBendLens[i] - len - bendAlpha * bendLambdas[i]) / (wa + 1.0f + bendAlpha);
+            bendLambdas[i] += dLambda;
+            xUnconstrained[i - 1] -= wa * dLambda * d / len;
+            xUnconstrained[i + 1] += dLambda * d / len;
+        }
+    }
+
+    handleCollisions(colliders);
+    projectFTL(dt);
+}
+
+template <int N>
+void ElasticRod<N>::projectFTL(float dt)
+{
+    const int n = numVerts();
+    float maxCorrectionChange = 0.0f;
+    for (int i = 1; i < n; i++) {
+        const Vector3f dir = (xUnconstrained[i] - xUnconstrained[i - 1]).normalized();
+        const Vector3f p = xUnconstrained[i - 1] + dir * initEdgeLen(i - 1);
+        maxCorrectionChange = std::max(maxCorrectionChange, (p - xUnconstrained[i] - correctionVecs[i]).norm() / initEdgeLen(i - 1));
+        correctionVecs[i] = p - xUnconstrained[i];
+        xUnconstrained[i] = p;
+    }
+    // FTL pushes every correction down the strand, the velocity of a vertex is
+    // corrected by the opposite of its child's correction to remove the bias
+    lastStepMotion = 0.0f;
+    float kineticEnergy = 0.0f;
+    for (int i = 1; i < n; i++) {
+        lastStepMotion = std::max(lastStepMotion, ((xUnconstrained[i] - x[i]).norm() + correctionVecs[i].norm()) / initEdgeLen(i - 1));
+        v[i] = (xUnconstrained[i] - x[i]) / dt;
+        kineticEnergy += 0.5f * v[i].squaredNorm();
+        if (i + 1 < n) {
+            v[i] -= ftlDamping * correctionVecs[i + 1] / dt;
+        }
+        x[i] = xUnconstrained[i];
+        assert(!v[i].hasNaN());
+    }
+    updateSleep(kineticEnergy, maxCorrectionChange);
+}
+
+
+template <int N>
+void ElasticRod<N>::updateSleep(float kineticEnergy, float maxCorrectionChange)
+{
+    // Unit vertex masses, so the energy threshold is half the squared RMS speed
+    const float maxEnergy = 0.5f * sleepSpeed * sleepSpeed * (numVerts() - 1);
+    if (!allowSleep || kineticEnergy > maxEnergy || maxCorrectionChange > sleepCorrection) {
+        calmSteps = 0;
+        return;
+    }
+    // v is kept, so the rod splats the same velocities into the grid while it
+    // sleeps and resumes from them when woken
+    if (++calmSteps >= sleepSteps) {
+        asleep = true;
+    }
+}
+
+template <int N>
+void ElasticRod<N>::wake()
+{
+    asleep = false;
+    hasSleepVelocities = false;
+    calmSteps = 0;
+}
+
+template <int N>
+void ElasticRod<N>::wakeOnContact(const ColliderSet& colliders)
+{
+    if (asleep && colliders.anyInside(x.data() + 1, x.size() - 1)) {
+        wake();
+    }
+}
 
-void ElasticRod::setVoxelContributions(const std::shared_ptr<VoxelGrid>& voxelGrid)
-{    
-    Eigen::Vector3f firstVoxelCoord,localPosition;
-    for (size_t ind = 1; ind < x.size(); ind++)
+template <int N>
+void ElasticRod<N>::setVoxelContributions(const std::shared_ptr<VoxelGrid>& voxelGrid, int chunk)
+{
+    for (size_t i = 1; i < x.size(); i++)
     {
-        voxelGrid->getVoxelCoordinates(x[ind],firstVoxelCoord,localPosition);
-        int numSteps = (int)(voxelGrid->voxelGridExtent/voxelGrid->voxelSize);
-        for(size_t i=0;i<=1;i++)
-            for(size_t j=0;j<=1;j++)
-                for(size_t k=0;k<=1;k++)
-                {
-                    Eigen::Vector3f corner = firstVoxelCoord + Eigen::Vector3f(i,j,k);
-                    if(corner(0)>=numSteps || corner(1)>=numSteps || corner(2)>=numSteps)
-                        continue;
-                    size_t hash = voxelGrid->getSpatialHash(corner);
-                    corner -= localPosition;
-                    corner = Eigen::Vector3f(1.0f,1.0f,1.0f) - Eigen::Vector3f(corner.array().abs()); 
-                    
-                    voxelGrid->voxelMutex->lock();            
-                    voxelGrid->voxelMasses[hash] += corner.prod();
-                    voxelGrid->voxelVelocities[hash] += corner.prod() * v[i];               
-                    voxelGrid->voxelMutex->unlock();
-                }
+        voxelGrid->splat(chunk, x[i], v[i]);
     }
 }
 
 
-void ElasticRod::updateAllVelocitiesFromVoxels(const std::shared_ptr<VoxelGrid>& voxelGrid)
+template <int N>
+void ElasticRod<N>::updateAllVelocitiesFromVoxels(const std::shared_ptr<VoxelGrid>& voxelGrid, float dt, float velocityScale)
 {
-    Eigen::Vector3f firstVoxelCoord, localPosition, velocity;
-    Eigen::Vector3f zeroVec = Eigen::Vector3f::Zero();
+    voxelGrid->sampleVelocities(x.data() + 1, x.size() - 1, sampledVelocities.data() + 1,
+                                sampledDensities.data() + 1, sampledDensityGradients.data() + 1);
+    // A sleeping rod wakes once the voxel velocities around it drift from what they
+    // were when it fell asleep, enough to drag it faster than sleepSpeed. Settled hair
+    // can keep a steady voxel velocity, so the absolute value would wake it at once.
+    if (asleep) {
+        for (size_t i = 1; i < x.size(); i++)
+        {
+            Eigen::Vector3f velocity = sampledVelocities[i] * velocityScale;
+            if (!hasSleepVelocities) {
+                sleepVelocities[i] = velocity;
+            } else if (friction * (velocity - sleepVelocities[i]).norm() > sleepSpeed) {
+                wake();
+                break;
+            }
+        }
+        hasSleepVelocities = asleep;
+        if (asleep) {
+            return;
+        }
+    }
     for (size_t i = 1; i < x.size(); i++)
     {
-        voxelGrid->getVoxelCoordinates(x[i], firstVoxelCoord, localPosition);
-
-        // Get the 8 velocities of the 8 corners of the voxel containing the sampling point
-        Eigen::Vector3f corner000, corner001, corner100, corner101, corner010, corner011, corner110, corner111;
-        voxelGrid->sampleVoxelVelocity(corner000, firstVoxelCoord);
-        voxelGrid->sampleVoxelVelocity(corner001, firstVoxelCoord + Eigen::Vector3f(0, 0, 1));
-        voxelGrid->sampleVoxelVelocity(corner100, firstVoxelCoord + Eigen::Vector3f(1, 0, 0));
-        voxelGrid->sampleVoxelVelocity(corner101, firstVoxelCoord + Eigen::Vector3f(1, 0, 1));
-        voxelGrid->sampleVoxelVelocity(corner010, firstVoxelCoord + Eigen::Vector3f(0, 1, 0));
-        voxelGrid->sampleVoxelVelocity(corner011, firstVoxelCoord + Eigen::Vector3f(0, 1, 1));
-        voxelGrid->sampleVoxelVelocity(corner110, firstVoxelCoord + Eigen::Vector3f(1, 1, 0));
-        voxelGrid->sampleVoxelVelocity(corner111, firstVoxelCoord + Eigen::Vector3f(1, 1, 1));
-
-        // Perform trilinear interpolation to get the velocity at the sampling point
-        Eigen::Vector3f lp_interp1 = (1.0f - localPosition[2]) * corner000 + localPosition[2] * corner001;
-        Eigen::Vector3f lp_interp2 = (1.0f - localPosition[2]) * corner100 + localPosition[2] * corner101;
-        Eigen::Vector3f lp = (1.0f - localPosition[0]) * lp_interp1 + localPosition[0] * lp_interp2;
-
-        Eigen::Vector3f up_interp1 = (1.0f - localPosition[2]) * corner010 + localPosition[2] * corner011;
-        Eigen::Vector3f up_interp2 = (1.0f - localPosition[2]) * corner110 + localPosition[2] * corner111;
-        Eigen::Vector3f up = (1.0f - localPosition[0]) * up_interp1 + localPosition[0] * up_interp2;
-
-        velocity = (1.0f - localPosition[1]) * lp + localPosition[1] * up;
-        velocity *= sampledVelocityScale;
+        Eigen::Vector3f velocity = sampledVelocities[i] * velocityScale;
         v[i] = (1-friction) * v[i] + friction * velocity;
+        v[i] += dt * volumeAcceleration(sampledDensities[i], sampledDensityGradients[i]);
+    }
+}
+
+template <int N>
+void ElasticRod<N>::storeRest(RodBatch::View rod) const
+{
+    for (size_t i = 0; i < x.size(); i++) {
+        rod.setXRest(i, xRest[i]);
+        rod.setRestCurvature(i, omega0[i][0], omega0[i][1]);
+    }
+}
+
+template <int N>
+void ElasticRod<N>::store(RodBatch::View rod) const
+{
+    for (size_t i = 0; i < x.size(); i++) {
+        rod.setX(i, x[i]);
+        rod.setV(i, v[i]);
+        rod.setFrame(i, bishopFrames[i].u, bishopFrames[i].v);
+        rod.setTheta(i, theta[i]);
+    }
+    rod.setRootEdge(rootEdge);
+}
+
+template <int N>
+void ElasticRod<N>::load(const RodBatch::View& rod)
+{
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = rod.x(i);
+        v[i] = rod.v(i);
+        bishopFrames[i] = {rod.frameU(i), rod.frameV(i)};
+        theta[i] = rod.theta(i);
     }
+    u0 = bishopFrames[0].u;
+    rootEdge = rod.rootEdge();
+    // The batch kernel steps sleeping rods too, so the sleep state no longer matches
+    lastStepMotion = 0.0f;
+    wake();
 }
 
-void ElasticRod::reset()
+template <int N>
+void ElasticRod<N>::reset()
 {
     for (int i = 0; i < x.size(); i++) {
         x[i] = xRest[i];
         v[i] = Vector3f::Zero();
+        theta[i] = 0.0f;
     }
+    // The root frame is transported in time, so it restarts from the rest edge
+    initRootFrame();
+    compGeometry();
+    compBishopFrames();
+    compMatFrames();
+    lastStepMotion = 0.0f;
+    wake();
+}
+
+template <int N>
+float ElasticRod<N>::minRestEdgeLen() const
+{
+    return *std::min_element(restEdgeLens.begin(), restEdgeLens.end());
 }
 
-void ElasticRod::bendingStiffness(float value)
+template <int N>
+void ElasticRod<N>::bendingStiffness(float value)
 {
     this->B = Matrix2f::Identity() * value;
 }
+
+template <int N>
+float ElasticRod<N>::bendingStiffness() const
+{
+    return B(0, 0);
+}
+
+// Runtime-length rods for grooms of arbitrary length, fixed-length rods for the scene's control hairs
+template class ElasticRod<Dynamic>;
+template class ElasticRod<HairMesh::controlHairLen>;
@@ -1,18 +1,91 @@
 #pragma once
 
 #include <array>
+#include <type_traits>
 #include <Util.hpp>
 #include <Eigen/Dense>
 #include <Scene.hpp>
 #include <VoxelGrid.hpp>
+#include <RodBatch.hpp>
+#include <ColliderSet.hpp>
+#include <BandedCholesky.hpp>
 
 using namespace Eigen;
 
+// Per-vertex storage: a std::array when the vertex count N is known at
+// compile time, a std::vector for rods sized at runtime (N = Dynamic)
+template <typename T, int N>
+using RodStorage = std::conditional_t<N == Dynamic, std::vector<T>, std::array<T, N == Dynamic ? 0 : N>>;
 
+// Simulation constants shared by rods of every length
+class ElasticRodBase
+{
+public:
+    // Gravity force added to each free vertex
+    static Vector3f gravity;
+    // [0,1] Simple velocity reduction factor
+    static float drag;
+    // [0,1] Interpolation factor for enforcing inextensibility constraint
+    static float inextensibility;
+    // Bending modulus (resistance to bending)
+    static float alpha;
+    // Twisting modulus (resistance to twist)
+    static float beta;
+    // Updates theta to minimize energy before every force pass
+    static bool quasiStaticTwist;
+    // Max Newton iterations of the quasi-static twist solve
+    static int twistIterations;
+    // Edge stiffness of the implicit step, above bendingStiffness() / l^3 for edges over 2.2 cm when that is 1
+    static float stretchStiffness;
+    // XPBD constraint iterations per step
+    static int xpbdIterations;
+    // XPBD compliance (inverse stiffness) of the bending constraints
+    static float bendCompliance;
+    // [0,1] Dynamic follow-the-leader velocity correction factor
+    static float ftlDamping;
+
+    // Used in voxel velocity update
+    static float friction, sampledVelocityScale;
+    // Voxel volume preservation: acceleration per unit density gradient, and the
+    // density (hair vertices per unit volume) above which hair is pushed apart
+    static float volumeStiffness, restDensity;
+
+    // Pressure acceleration pushing hair down the density gradient where it is
+    // denser than restDensity, an O(n) stand-in for hair-hair collisions
+    static Vector3f volumeAcceleration(float density, const Vector3f& densityGradient)
+    {
+        if (density <= restDensity) {
+            return Vector3f::Zero();
+        }
+        return -volumeStiffness * (1.0f - restDensity / density) * densityGradient;
+    }
+
+    // Rods may stop integrating once settled
+    static bool allowSleep;
+    // RMS vertex speed below which a rod counts as calm
+    static float sleepSpeed;
+    // Largest change of a vertex's constraint correction between steps, in rest
+    // edge lengths, for a calm rod. Hanging hair is corrected every step, so
+    // settling shows up as corrections that stop changing rather than vanish.
+    static float sleepCorrection;
+    // Consecutive calm steps before a rod falls asleep
+    static int sleepSteps;
+};
 
-class ElasticRod
+// Discrete elastic rod with N vertices. Fixed-length rods keep all of their
+// state inline, runtime-length rods (N = Dynamic) allocate it in init().
+template <int N = Dynamic>
+class ElasticRod : public ElasticRodBase
 {
 private:
+    // Edge storage has a ghost entry on either end, so N + 1 slots
+    static constexpr int edgeSlots = N == Dynamic ? Dynamic : N + 1;
+    // Bending element k couples x[k-1] with x[k+1], so the Hessian is zero
+    // outside 2 blocks (8 scalars) of the diagonal
+    static constexpr int hessianBandwidth = 8;
+    static constexpr int dofSlots = N == Dynamic ? Dynamic : 3 * N;
+    static constexpr int bandSlots = N == Dynamic ? Dynamic : 3 * N * (hessianBandwidth + 1);
+
     struct BishopFrame
     {
         Vector3f u = Vector3f::Zero();
@@ -30,7 +103,7 @@ private:
     };
 
     // Curvature binormal
-    Vector3f kappaB(int i);
+    const Vector3f& kappaB(int i);
     // Initial edge length
     float initEdgeLen(int i);
     // Gradient holonomy term i,j
@@ -38,83 +111,164 @@ private:
     // Gradient of curvature binormal i wrt x j
     Matrix3f kappaBGrad(int i, int j);
     // Edge vector (i+1) - i
-    Vector3f edge(int i);
-    // Initial edge vector (i+1) - i
-    Vector3f initEdge(int i);
+    const Vector3f& edge(int i);
+    // Edge length |(i+1) - i|
+    float edgeLen(int i);
     // Force acting on vertex i
     Vector3f force(int i);
+    // Rotates u by the minimal rotation taking direction e0 to e1, without trig
+    static Vector3f parallelTransport(const Vector3f& e0, float len0, const Vector3f& e1, float len1, const Vector3f& u);
     // Computes next u vector via parallel transport
     Vector3f parallelTransportFrame(int i, const Vector3f& u);
     // Material curvature for (i,j)
     Vector2f omega(int i, int j);
-    // Gradient of material curvature
-    Matrix<float, 2, 3> omegaGrad(int i, int j, int k);
-    // Compute gradient holonomy from gradient holonomy terms
-    Vector3f gradHolonomy(int i, int j);
-    // Energy derivative dEdX for vertex i
-    Vector3f dEdX(int i);
-    // Energy derivative dE/dTheta for 
+    // Assembles -dE/dX for every vertex in one pass over the bending elements,
+    // optionally with the Gauss-Newton bending Hessian H into systemBand and H v into hessianV
+    void compForces(bool assembleHessian = false);
+
+    // Adds block (ia, ib) of the implicit system Hessian to systemBand and its product with v to hessianV
+    void addHessianBlock(int ia, int ib, const Matrix3f& h);
+
+    // Follow-the-leader length projection of xUnconstrained, then updates x and
+    // v with the dynamic FTL velocity correction (Mueller et al. 2012)
+    void projectFTL(float dt);
 
+    // Recomputes edges, edge lengths and curvature binormals from x
+    void compGeometry();
+    // Sets u0 perpendicular to the rest root edge, the start of the time transport
+    void initRootFrame();
     // Generates the bishop frames
     void compBishopFrames();
     // Recomputes the material frames
     void compMatFrames();
+    // Quasi-static twist: Newton iterations on theta with the root angle fixed,
+    // each solving the tridiagonal energy Hessian in O(n)
+    void updateTwist();
     // Computes gradient holonomy terms
     void compGradHolonomyTerms();
 
     // Intergrated position of vertices before inextensibility constraint
-    std::vector<Vector3f> xUnconstrained; 
+    RodStorage<Vector3f, N> xUnconstrained; 
     // Vertex offsets for inextensibility constraint
-    std::vector<Vector3f> correctionVecs; 
+    RodStorage<Vector3f, N> correctionVecs; 
     // Bishop (rest) frames
-    std::vector<BishopFrame> bishopFrames;
+    RodStorage<BishopFrame, N> bishopFrames;
     // Material (active) frames
-    std::vector<MaterialFrame> M;
+    RodStorage<MaterialFrame, N> M;
     // Initial twisting vector
     Vector3f u0 = {0.0f, 0.0f, 0.0f};
+    // Edge 0 when u0 was last updated, u0 is transported in time from it
+    Vector3f rootEdge = {0.0f, 0.0f, 0.0f};
+    // Rest distances between x[i-1] and x[i+1], targets of the XPBD bending constraints
+    RodStorage<float, N> restBendLens;
+    // XPBD multipliers of the bending constraints, accumulated over one step
+    RodStorage<float, N> bendLambdas;
     // Bending stiffness matrix B
     Matrix2f B = Matrix2f::Identity() * 1.0f;
-    // Material curvature at rest for i, j, where j:(i-1, i, i+1)
-    std::vector<std::array<Vector2f, 2u>> omega0;
+    // Rest material curvature of bending element i in frames i-1 and i, so
+    // omega0[i][j] is the rest value of omega(i, i + j - 1)
+    RodStorage<std::array<Vector2f, 2u>, N> omega0;
     // Bending angles
-    std::vector<float> theta;
+    RodStorage<float, N> theta;
+    // Newton system of updateTwist(), diagonal, superdiagonal and right-hand side
+    RodStorage<float, N> twistDiag, twistOff, twistRhs;
     // Gradient holonomy terms (i-1, i, i+1) for each vertex
-    std::vector<std::array<Vector3f, 3u>> gradHolonomyTerms;
+    RodStorage<std::array<Vector3f, 3u>, N> gradHolonomyTerms;
+    // Bending forces assembled by compForces()
+    RodStorage<Vector3f, N> forces;
+    // Per-frame holonomy weights, suffix-summed during force assembly
+    RodStorage<float, N> holonomyWeights;
+    // Per-step geometry cache filled by compGeometry(). Edge i is stored at
+    // slot i + 1, slots 0 and n repeat the first and last edge so edge(-1)
+    // and edge(n - 1) need no clamping.
+    RodStorage<Vector3f, edgeSlots> edges;
+    RodStorage<float, edgeSlots> edgeLens;
+    RodStorage<Vector3f, N> kbs;
+    // Curvature binormal denominators |e0_i-1||e0_i| + e_i-1 . e_i, see compGeometry()
+    RodStorage<float, N> kbDenoms;
+    // Gradients of kbDenoms wrt e_i-1 and e_i
+    RodStorage<std::array<Vector3f, 2u>, N> kbDenomGrads;
+    // Rest edge lengths, fixed at init(), same layout as edgeLens
+    RodStorage<float, edgeSlots> restEdgeLens;
+    // Rest part |e0_i-1||e0_i| of the curvature binormal denominators
+    RodStorage<float, N> restKbDenoms;
+    // Lower band of the implicit system I + dt^2 H, factored in place
+    RodStorage<float, bandSlots> systemBand;
+    // Right hand side of the implicit system, overwritten with the velocity change
+    RodStorage<float, dofSlots> deltaV;
+    // Bending Hessian times the current velocities
+    RodStorage<Vector3f, N> hessianV;
+    // Largest vertex motion of the last step, see stepMotion()
+    float lastStepMotion = 0.0f;
+    // Counts calm steps, the rod sleeps once this reaches sleepSteps
+    int calmSteps = 0;
+    bool asleep = false;
+    // Voxel velocities sampled when the rod fell asleep, it wakes once they change
+    RodStorage<Vector3f, N> sleepVelocities;
+    bool hasSleepVelocities = false;
+    // Voxel velocities, densities and density gradients gathered at x by updateAllVelocitiesFromVoxels()
+    RodStorage<Vector3f, N> sampledVelocities;
+    RodStorage<float, N> sampledDensities;
+    RodStorage<Vector3f, N> sampledDensityGradients;
+
+    // Advances the sleep state from the last step's kinetic energy and largest correction change
+    void updateSleep(float kineticEnergy, float maxCorrectionChange);
 public:
     // particle positions at rest
-    std::vector<Vector3f> xRest;
+    RodStorage<Vector3f, N> xRest;
     // particle positions
-    std::vector<Vector3f> x;
+    RodStorage<Vector3f, N> x;
     // particle velocities
-    std::vector<Vector3f> v;
-
-    // Gravity force added to each free vertex
-    static Vector3f gravity;
-    // [0,1] Simple velocity reduction factor
-    static float drag;
-    // [0,1] Interpolation factor for enforcing inextensibility constraint
-    static float inextensibility;
-    // Bending modulus (resistance to bending)
-    static float alpha;
-
-    // Used in voxel velocity update
-    static float friction, sampledVelocityScale;
+    RodStorage<Vector3f, N> v;
 
     ElasticRod() = default;
     ElasticRod(const std::vector<glm::vec3>& verts);
 
     void init(const std::vector<glm::vec3>& verts);
     void integrateFwEuler(float dt);
-    void handleCollisions(const std::vector<std::shared_ptr<SceneObject>>& colliders);
-    void enforceConstraints(float dt,const std::vector<std::shared_ptr<SceneObject>>& colliders);
+    // Linearized backward Euler step, solves (I + dt^2 H) dv = dt (f - dt H v) per rod
+    void integrateImplicitEuler(float dt);
+    // Pushes xUnconstrained out of the colliders, testing the path from x to it
+    void handleCollisions(const ColliderSet& colliders);
+    void enforceConstraints(float dt,const ColliderSet& colliders);
+    // Position based alternative to integrate + enforceConstraints: XPBD distance and
+    // bending constraints, collisions, then dynamic follow-the-leader projection
+    void integrateXPBD(float dt, const ColliderSet& colliders);
     
 
     
-    void setVoxelContributions(const std::shared_ptr<VoxelGrid>& voxelGrid);
-    void updateAllVelocitiesFromVoxels(const std::shared_ptr<VoxelGrid>& voxelGrid);
+    // Splats every vertex into the given VoxelGrid chunk
+    void setVoxelContributions(const std::shared_ptr<VoxelGrid>& voxelGrid, int chunk);
+    // Blends velocities towards the voxel average scaled by velocityScale, and applies the
+    // volume preservation force over dt. Steps that keep v between steps (XPBD) need a
+    // scale of at most 1, or the blend amplifies motion.
+    void updateAllVelocitiesFromVoxels(const std::shared_ptr<VoxelGrid>& voxelGrid, float dt, float velocityScale = sampledVelocityScale);
+
+    // Copies rest positions and rest curvature into a batch slot
+    void storeRest(RodBatch::View rod) const;
+    // Copies positions, velocities, frames and the root edge into a batch slot
+    void store(RodBatch::View rod) const;
+    // Copies positions, velocities, frames and the root edge back from a batch slot
+    void load(const RodBatch::View& rod);
 
     // Reset simulation to rest state
     void reset();
     // Sets the bending stiffness constant
     void bendingStiffness(float value);
+    // Returns the bending stiffness constant
+    float bendingStiffness() const;
+    // Number of vertices, a compile-time constant for fixed-length rods
+    inline int numVerts() const { return (int)x.size(); }
+    // Largest displacement plus constraint correction of a vertex in the last
+    // step, in units of its rest edge length
+    float stepMotion() const { return lastStepMotion; }
+    // Shortest rest edge length
+    float minRestEdgeLen() const;
+    // Sleeping rods skip integration and constraints, but still splat their last
+    // velocities into the voxel grid
+    bool sleeping() const { return asleep; }
+    void wake();
+    // Wakes a sleeping rod if any of its vertices is inside one of the given
+    // colliders, meant for colliders that moved since the last step
+    void wakeOnContact(const ColliderSet& colliders);
 };
@@ -0,0 +1,300 @@
+#include <HairCollision.hpp>
+#include <ElasticRod.hpp>
+#include <VoxelGrid.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <execution>
+#include <numeric>
+
+namespace
+{
+    // Closest points p1 + s (q1 - p1) and p2 + t (q2 - p2) of two segments,
+    // returns their squared distance (Ericson, Real-Time Collision Detection 5.1.9)
+    float closestPoints(const Eigen::Vector3f& p1, const Eigen::Vector3f& q1,
+                        const Eigen::Vector3f& p2, const Eigen::Vector3f& q2, float& s, float& t)
+    {
+        constexpr float eps = 1e-12f;
+        const Eigen::Vector3f d1 = q1 - p1;
+        const Eigen::Vector3f d2 = q2 - p2;
+        const Eigen::Vector3f r = p1 - p2;
+        const float a = d1.dot(d1);
+        const float e = d2.dot(d2);
+        const float f = d2.dot(r);
+        if (a <= eps && e <= eps) {
+            s = t = 0.0f;
+        } else if (a <= eps) {
+            s = 0.0f;
+            t = std::clamp(f / e, 0.0f, 1.0f);
+        } else {
+            const float c = d1.dot(r);
+            if (e <= eps) {
+                t = 0.0f;
+                s = std::clamp(-c / a, 0.0f, 1.0f);
+            } else {
+                const float b = d1.dot(d2);
+                const float denom = a * e - b * b;
+                s = denom > eps ? std::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+                t = (b * s + f) / e;
+                if (t < 0.0f) {
+                    t = 0.0f;
+                    s = std::clamp(-c / a, 0.0f, 1.0f);
+                } else if (t > 1.0f) {
+                    t = 1.0f;
+                    s = std::clamp((b - c) / a, 0.0f, 1.0f);
+                }
+            }
+        }
+        return (p1 + s * d1 - p2 - t * d2).squaredNorm();
+    }
+
+    int bucketOf(const Eigen::Vector3i& cell, size_t mask)
+    {
+        return (int)(VoxelTable::hash(VoxelGrid::getVoxelKey(cell)) & mask);
+    }
+
+    void addTime(std::atomic<float>& avgTime, std::chrono::high_resolution_clock::time_point start)
+    {
+        const float time = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+        avgTime = avgTime == 0.0f ? time : avgTime * 0.99f + time * 0.01f; // rolling average
+    }
+}
+
+template <int N>
+void HairCollision::resolve(std::vector<ElasticRod<N>>& rods, float dt)
+{
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        collectSegments(rods);
+        if (iteration == 0) {
+            auto start = std::chrono::high_resolution_clock::now();
+            broadPhase();
+            addTime(broadPhaseTime, start);
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        narrowPhase();
+        addTime(narrowPhaseTime, start);
+        start = std::chrono::high_resolution_clock::now();
+        applyContacts(rods, dt);
+        addTime(resolveTime, start);
+    }
+}
+
+template <int N>
+void HairCollision::collectSegments(const std::vector<ElasticRod<N>>& rods)
+{
+    rodSegmentBegin.resize(rods.size() + 1);
+    rodSegmentBegin[0] = 0;
+    for (size_t r = 0; r < rods.size(); r++) {
+        rodSegmentBegin[r + 1] = rodSegmentBegin[r] + std::max(rods[r].numVerts() - 1, 0);
+    }
+    rodAsleep.resize(rods.size());
+    segments.resize(rodSegmentBegin.back());
+    numSegments = segments.size();
+
+    std::vector<int> rodIndices(rods.size());
+    std::iota(rodIndices.begin(), rodIndices.end(), 0);
+    std::for_each(std::execution::par_unseq, rodIndices.begin(), rodIndices.end(), [&](int r)
+    {
+        const ElasticRod<N>& rod = rods[r];
+        rodAsleep[r] = rod.sleeping();
+        for (int i = 0; i + 1 < rod.numVerts(); i++) {
+            Segment& segment = segments[rodSegmentBegin[r] + i];
+            segment.a = rod.x[i];
+            segment.b = rod.x[i + 1];
+            segment.rod = r;
+            segment.vertex = i;
+        }
+    });
+}
+
+void HairCollision::broadPhase()
+{
+    // Cells fit the longest segment and both radii, so capsules that touch
+    // have their midpoints in the same or neighbouring cells
+    float maxLen = 0.0f;
+    for (const Segment& segment : segments) {
+        maxLen = std::max(maxLen, (segment.b - segment.a).squaredNorm());
+    }
+    cellSize = std::sqrt(maxLen) + 2.0f * radius;
+
+    size_t numBuckets = 16;
+    while (numBuckets < 2 * segments.size()) {
+        numBuckets *= 2;
+    }
+    const size_t mask = numBuckets - 1;
+    segmentBuckets.resize(segments.size());
+    unsortedProxies.resize(segments.size());
+    std::for_each(std::execution::par_unseq, segments.begin(), segments.end(), [&](const Segment& segment)
+    {
+        const int s = (int)(&segment - segments.data());
+        Proxy& proxy = unsortedProxies[s];
+        const Eigen::Vector3f mid = 0.5f * (segment.a + segment.b) / cellSize;
+        proxy.cell = Eigen::Vector3f(mid.array().floor()).cast<int>();
+        proxy.lower = segment.a.cwiseMin(segment.b).array() - radius;
+        proxy.upper = segment.a.cwiseMax(segment.b).array() + radius;
+        proxy.rod = segment.rod;
+        proxy.segment = s;
+        segmentBuckets[s] = bucketOf(proxy.cell, mask);
+    });
+
+    // Counting sort by bucket, stable so the order is deterministic. Neighbour
+    // scans then read each bucket's proxies contiguously.
+    bucketStart.assign(numBuckets + 1, 0);
+    for (int bucket : segmentBuckets) {
+        bucketStart[bucket + 1]++;
+    }
+    std::partial_sum(bucketStart.begin(), bucketStart.end(), bucketStart.begin());
+    proxies.resize(segments.size());
+    {
+        std::vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t s = 0; s < segments.size(); s++) {
+            proxies[fill[segmentBuckets[s]]++] = unsortedProxies[s];
+        }
+    }
+
+    // Each pair is found once: cells only look at the 13 neighbours ahead of them,
+    // and pairs within a cell from their lower segment index
+    static const std::array<Eigen::Vector3i, 14> neighbours = [] {
+        std::array<Eigen::Vector3i, 14> offsets;
+        int count = 0;
+        for (int dz = -1; dz <= 1; dz++)
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                    if (dz > 0 || (dz == 0 && (dy > 0 || (dy == 0 && dx >= 0))))
+                        offsets[count++] = Eigen::Vector3i(dx, dy, dz);
+        return offsets;
+    }();
+    chunkCandidates.resize(chunks);
+    std::vector<int> chunkIndices(chunks);
+    std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+    // Chunks grow their own candidate lists, allocating is not allowed under par_unseq
+    std::for_each(std::execution::par, chunkIndices.begin(), chunkIndices.end(), [&](int chunk)
+    {
+        std::vector<std::pair<int, int>>& candidates = chunkCandidates[chunk];
+        candidates.clear();
+        const size_t end = proxies.size() * (chunk + 1) / chunks;
+        for (size_t p = proxies.size() * chunk / chunks; p < end; p++) {
+            const Proxy& proxy = proxies[p];
+            for (const Eigen::Vector3i& offset : neighbours) {
+                const Eigen::Vector3i cell = proxy.cell + offset;
+                const bool sameCell = offset.isZero();
+                const int bucket = bucketOf(cell, mask);
+                for (int j = bucketStart[bucket]; j < bucketStart[bucket + 1]; j++) {
+                    const Proxy& other = proxies[j];
+                    // Buckets are shared by colliding cells, so check the cell itself
+                    if (other.cell != cell || (sameCell && other.segment <= proxy.segment) || other.rod == proxy.rod ||
+                        (rodAsleep[proxy.rod] && rodAsleep[other.rod])) {
+                        continue;
+                    }
+                    if ((proxy.lower.array() <= other.upper.array()).all() &&
+                        (other.lower.array() <= proxy.upper.array()).all()) {
+                        candidates.emplace_back(std::min(proxy.segment, other.segment), std::max(proxy.segment, other.segment));
+                    }
+                }
+            }
+        }
+    });
+    size_t candidateCount = 0;
+    for (const auto& candidates : chunkCandidates) {
+        candidateCount += candidates.size();
+    }
+    numCandidates = candidateCount;
+}
+
+void HairCollision::narrowPhase()
+{
+    const float minDist = 2.0f * radius;
+    chunkContacts.resize(chunks);
+    std::vector<int> chunkIndices(chunks);
+    std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+    // par for the same reason as the broad phase, contact lists grow
+    std::for_each(std::execution::par, chunkIndices.begin(), chunkIndices.end(), [&](int chunk)
+    {
+        std::vector<Contact>& found = chunkContacts[chunk];
+        found.clear();
+        for (const auto& [segA, segB] : chunkCandidates[chunk]) {
+            const Segment& a = segments[segA];
+            const Segment& b = segments[segB];
+            float s, t;
+            const float distSq = closestPoints(a.a, a.b, b.a, b.b, s, t);
+            if (distSq >= minDist * minDist || distSq == 0.0f) {
+                continue;
+            }
+            const float dist = std::sqrt(distSq);
+            const Eigen::Vector3f normal = ((a.a + s * (a.b - a.a)) - (b.a + t * (b.b - b.a))) / dist;
+            found.push_back({segA, segB, s, t, normal, minDist - dist});
+        }
+    });
+
+    contacts.clear();
+    for (const auto& found : chunkContacts) {
+        contacts.insert(contacts.end(), found.begin(), found.end());
+    }
+    numContacts = contacts.size();
+
+    // Bucket contacts by segment so each rod can find its own
+    segmentContactStart.assign(segments.size() + 1, 0);
+    for (const Contact& contact : contacts) {
+        segmentContactStart[contact.segA + 1]++;
+        segmentContactStart[contact.segB + 1]++;
+    }
+    std::partial_sum(segmentContactStart.begin(), segmentContactStart.end(), segmentContactStart.begin());
+    segmentContacts.resize(2 * contacts.size());
+    std::vector<int> fill(segmentContactStart.begin(), segmentContactStart.end() - 1);
+    for (size_t c = 0; c < contacts.size(); c++) {
+        segmentContacts[fill[contacts[c].segA]++] = 2 * (int)c;
+        segmentContacts[fill[contacts[c].segB]++] = 2 * (int)c + 1;
+    }
+}
+
+template <int N>
+void HairCollision::applyContacts(std::vector<ElasticRod<N>>& rods, float dt)
+{
+    corrections.assign(segments.size() + rods.size(), Eigen::Vector3f::Zero());
+    correctionCounts.assign(segments.size() + rods.size(), 0);
+
+    std::vector<int> rodIndices(rods.size());
+    std::iota(rodIndices.begin(), rodIndices.end(), 0);
+    std::for_each(std::execution::par_unseq, rodIndices.begin(), rodIndices.end(), [&](int r)
+    {
+        const int vertexBegin = rodSegmentBegin[r] + r;
+        bool touched = false;
+        for (int seg = rodSegmentBegin[r]; seg < rodSegmentBegin[r + 1]; seg++) {
+            const int vertex = vertexBegin + segments[seg].vertex;
+            for (int k = segmentContactStart[seg]; k < segmentContactStart[seg + 1]; k++) {
+                const Contact& contact = contacts[segmentContacts[k] / 2];
+                const bool sideA = (segmentContacts[k] & 1) == 0;
+                const float u = sideA ? contact.s : contact.t;
+                // Each side takes half the depth, spread over its end points so
+                // the closest point itself moves by that much
+                const Eigen::Vector3f correction = (sideA ? 0.5f : -0.5f) * contact.depth * contact.normal /
+                                                   ((1.0f - u) * (1.0f - u) + u * u);
+                corrections[vertex] += (1.0f - u) * correction;
+                corrections[vertex + 1] += u * correction;
+                correctionCounts[vertex]++;
+                correctionCounts[vertex + 1]++;
+                touched = true;
+            }
+        }
+        if (!touched) {
+            return;
+        }
+
+        ElasticRod<N>& rod = rods[r];
+        if (rod.sleeping()) {
+            rod.wake();
+        }
+        // The root is attached to the scalp and never moves
+        for (int i = 1; i < rod.numVerts(); i++) {
+            if (correctionCounts[vertexBegin + i] == 0) {
+                continue;
+            }
+            const Eigen::Vector3f delta = corrections[vertexBegin + i] / (float)correctionCounts[vertexBegin + i];
+            rod.x[i] += delta;
+            rod.v[i] += delta / dt;
+        }
+    });
+}
+
+template void HairCollision::resolve(std::vector<ElasticRod<Dynamic>>& rods, float dt);
+template void HairCollision::resolve(std::vector<ElasticRod<HairMesh::controlHairLen>>& rods, float dt);
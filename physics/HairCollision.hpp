@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <Eigen/Dense>
+
+template <int N> class ElasticRod;
+
+// Strand-strand contact between rod segments treated as capsules. A uniform
+// spatial hash over segment midpoints finds candidate pairs, capsule-capsule
+// tests turn them into contacts, and every rod then applies the averaged
+// (Jacobi) corrections of its own contacts, so rods resolve in parallel
+// without locks and with the same result on any core count.
+class HairCollision
+{
+public:
+    // Candidate pairs and contacts are gathered in this many fixed chunks
+    static constexpr int chunks = 16;
+
+    // Pushes apart segments of different rods that are closer than 2 * radius,
+    // and adds the position change over dt to the velocities
+    template <int N>
+    void resolve(std::vector<ElasticRod<N>>& rods, float dt);
+
+    // Capsule radius of a strand
+    float radius = 0.01f;
+    // Projection passes per step, the broad phase only runs on the first
+    int iterations = 2;
+
+    // Rolling average wall time of each stage in seconds. These and the sizes below
+    // are written while stepping and read by the GUI from the render thread.
+    std::atomic<float> broadPhaseTime = 0.0f;
+    std::atomic<float> narrowPhaseTime = 0.0f;
+    std::atomic<float> resolveTime = 0.0f;
+    // Sizes of the last resolve()
+    std::atomic<size_t> numSegments = 0;
+    std::atomic<size_t> numCandidates = 0;
+    std::atomic<size_t> numContacts = 0;
+
+private:
+    struct Segment
+    {
+        Eigen::Vector3f a, b;
+        int rod;
+        // Rod vertex at a, b is the next one
+        int vertex;
+    };
+
+    // What the broad phase reads of a segment, stored in bucket order
+    struct Proxy
+    {
+        // Bounds of the capsule
+        Eigen::Vector3f lower, upper;
+        // Spatial hash cell of the midpoint
+        Eigen::Vector3i cell;
+        int rod;
+        int segment;
+    };
+
+    struct Contact
+    {
+        int segA, segB;
+        // Closest points along each segment, in [0, 1]
+        float s, t;
+        // Unit direction from segment B to segment A
+        Eigen::Vector3f normal;
+        float depth;
+    };
+
+    // Copies segment end points out of the rods, and their sleep state
+    template <int N>
+    void collectSegments(const std::vector<ElasticRod<N>>& rods);
+    // Sorts segments into the spatial hash and lists nearby pairs of different rods
+    void broadPhase();
+    // Keeps the candidate pairs whose capsules overlap
+    void narrowPhase();
+    // Moves each rod's vertices by the average correction of their contacts
+    template <int N>
+    void applyContacts(std::vector<ElasticRod<N>>& rods, float dt);
+
+    std::vector<Segment> segments;
+    // First segment of each rod, followed by the total
+    std::vector<int> rodSegmentBegin;
+    std::vector<char> rodAsleep;
+    float cellSize = 1.0f;
+    // Counting sorted spatial hash: the segments of bucket b are
+    // proxies[bucketStart[b], bucketStart[b + 1])
+    std::vector<int> segmentBuckets;
+    std::vector<int> bucketStart;
+    std::vector<Proxy> unsortedProxies;
+    std::vector<Proxy> proxies;
+    std::vector<std::vector<std::pair<int, int>>> chunkCandidates;
+    std::vector<std::vector<Contact>> chunkContacts;
+    std::vector<Contact> contacts;
+    // Contacts of segment s are segmentContacts[segmentContactStart[s], segmentContactStart[s + 1]),
+    // stored as 2 * contact + side, side 0 for segA and 1 for segB
+    std::vector<int> segmentContactStart;
+    std::vector<int> segmentContacts;
+    // Per-vertex correction sums and contact counts, rod r's vertices start at rodSegmentBegin[r] + r
+    std::vector<Eigen::Vector3f> corrections;
+    std::vector<int> correctionCounts;
+};
@@ -1,53 +1,363 @@
 #include <PhysicsIntegrator.hpp>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
 #include <execution>
 #include <sstream>
 
 
 void PhysicsIntegrator::Initialize()
 {
-    // Initialize the physics integrator here
+    isa = rodkernels::detectISA();
+    spdlog::info("Rod kernels: {} ({} rods per packet)", rodkernels::isaName(isa), rodkernels::laneWidth(isa));
+}
+
+void PhysicsIntegrator::setBatchKernel(bool enabled)
+{
+    if (enabled == batchKernel) {
+        return;
+    }
+    // Hand the simulation state over to whichever side runs next
+    if (enabled) {
+        scene->rodBatch.gather(scene->rods);
+    } else {
+        scene->rodBatch.scatter(scene->rods);
+    }
+    batchKernel = enabled;
+}
+
+bool PhysicsIntegrator::PackSphereColliders()
+{
+    spheres.clear();
+    if (!colliders.boxes.empty() || !colliders.capsules.empty() || !colliders.sdfs.empty() || !colliders.others.empty()) {
+        return false;
+    }
+    for (const ColliderSet::Sphere& sphere : colliders.spheres) {
+        // The kernel only handles round spheres, rotated or uniformly scaled
+        const Matrix3f& toWorld = sphere.frame.toWorld;
+        const float scale = toWorld.col(0).norm();
+        if (!(toWorld.transpose() * toWorld).isApprox(Matrix3f::Identity() * (scale * scale), 1e-4f)) {
+            spheres.clear();
+            return false;
+        }
+        const Vector3f& center = sphere.frame.center;
+        spheres.insert(spheres.end(), {center.x(), center.y(), center.z(), sphere.radius * scale});
+    }
+    return true;
 }
 
 void PhysicsIntegrator::Integrate()
 {
-    for (int i = 0; i < numSteps; i++) {
-        TakeStep(dt);
+    int steps = numSteps;
+    if (adaptiveSteps) {
+        steps = AdaptiveStepCount();
+    }
+    const float stepDt = dt * numSteps / steps;
+    for (int i = 0; i < steps; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        UpdateColliders(i, steps);
+        TakeStep(stepDt);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::atomic<float>& avgStepTime = avgStepTimes[(int)solver];
+        const float stepTime = std::chrono::duration<float>(end - start).count();
+        avgStepTime = avgStepTime == 0.0f ? stepTime : avgStepTime * 0.99f + stepTime * 0.01f; // rolling average
+    }
+    lastStepCount = steps;
+    for (size_t i = 0; i < colliderCenters.size() && i < scene->sceneObjects.size(); i++) {
+        colliderCenters[i] = scene->sceneObjects[i]->collider->center;
+    }
+    // The batch kernel steps every rod, whatever the sleep flags it left behind say
+    sleepingRods = batchKernel ? 0 : (int)std::count_if(scene->rods.begin(), scene->rods.end(), [](const auto& rod) { return rod.sleeping(); });
+    occupiedVoxels = scene->voxelGrid->numOccupied();
+    if (!batchKernel) {
+        scene->rodBatch.gather(scene->rods);
+    }
+}
+
+int PhysicsIntegrator::Advance(float elapsed, std::chrono::steady_clock::time_point now)
+{
+    const float period = 1.0f / tickRate;
+    accumulator += elapsed;
+    const int due = (int)(accumulator / period);
+    const int ticks = std::min(due, maxCatchUp);
+    accumulator -= (due - ticks) * period;
+    for (int i = 0; i < ticks; i++) {
+        Integrate();
+        accumulator -= period;
+        // Publish the tick, the render thread picks it up in Renderer::PostPhysicsSync()
+        const auto dueAt = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(accumulator));
+        scene->hairMesh.updateFrom(scene->rodBatch, dueAt, period);
+    }
+    return ticks;
+}
+
+int PhysicsIntegrator::AdaptiveStepCount()
+{
+    float motion = 0.0f;
+    float minEdgeLen = std::numeric_limits<float>::max();
+    for (const auto& rod : scene->rods) {
+        // The batch kernel does not write back to the rods, so their motion is stale
+        if (!batchKernel) {
+            motion = std::max(motion, rod.stepMotion());
+        }
+        minEdgeLen = std::min(minEdgeLen, rod.minRestEdgeLen());
+    }
+    // Motion per step shrinks with the step length, so scale last frame's
+    // step count by how far its motion was off the target. No rod has a motion
+    // under the batch kernel or before its first step after a reset, then the
+    // fixed count is kept.
+    float steps = motion > 0.0f ? lastStepCount * motion / targetMotion : numSteps;
+
+    // A collider moving further than the target per step tunnels through hair, unless
+    // the collisions are continuous. Colliders only move between frames, so this is
+    // their motion over one frame.
+    for (size_t i = 0; !continuousCollisions && i < colliderCenters.size() && i < scene->sceneObjects.size(); i++) {
+        const Vector3f& center = scene->sceneObjects[i]->collider->center;
+        if (!scene->rods.empty()) {
+            steps = std::max(steps, (center - colliderCenters[i]).norm() / (targetMotion * minEdgeLen));
+        }
+    }
+
+    int count = std::clamp((int)std::ceil(steps), 1, maxSteps);
+    const float stepTime = avgStepTimes[(int)solver];
+    if (stepTime > 0.0f) {
+        count = std::min(count, std::max((int)(frameBudget / stepTime), 1));
+    }
+    // Forward Euler is only stable up to dt, so it never takes longer steps
+    if (solver == Solver::DER && integrator == Integrator::ForwardEuler) {
+        count = std::max(count, numSteps);
+    }
+    return count;
+}
+
+void PhysicsIntegrator::UpdateColliders(int step, int steps)
+{
+    const std::vector<std::shared_ptr<SceneObject>>& objects = scene->sceneObjects;
+    colliders.continuous = continuousCollisions;
+    if (colliderCenters.size() != objects.size()) {
+        colliderCenters.clear();
+        for (const std::shared_ptr<SceneObject>& obj : objects) {
+            colliderCenters.push_back(obj->collider->center);
+        }
+        colliders.build(objects);
+        movedColliders.build(objects);
+        return;
     }
-    //Call Event Handler to scynronize the rendering geometry with the physics
-    for (size_t i = 0; i < scene->rods.size(); i++) {
-        scene->hairMesh.updateFrom(scene->rods[i], i);
+    const float from = continuousCollisions ? (float)step / steps : 1.0f;
+    const float to = continuousCollisions ? (float)(step + 1) / steps : 1.0f;
+    std::vector<Vector3f> centers, motions;
+    std::vector<std::shared_ptr<SceneObject>> moved;
+    std::vector<Vector3f> movedCenters, movedMotions;
+    for (size_t i = 0; i < objects.size(); i++) {
+        const Vector3f frameMotion = objects[i]->collider->center - colliderCenters[i];
+        centers.push_back(colliderCenters[i] + frameMotion * to);
+        motions.push_back(frameMotion * (to - from));
+        // Without continuous collisions the whole frame's motion happens before the first substep
+        if (frameMotion != Vector3f::Zero() && (continuousCollisions || step == 0)) {
+            moved.push_back(objects[i]);
+            movedCenters.push_back(centers.back());
+            movedMotions.push_back(motions.back());
+        }
     }
-    // Call Event Handler to scynronize the rendering geometry with the physics
-    Event e;
-    e.type = Event::Type::PhysicsSync;
-    EventHandler::GetInstance().QueueEvent(e);
+    colliders.build(objects, centers, motions);
+    movedColliders.build(moved, movedCenters, movedMotions);
 }
 
 void PhysicsIntegrator::TakeStep(float dt)
 {
+    if (batchKernel && !PackSphereColliders()) {
+        spdlog::warn("Batch rod kernel only supports evenly scaled sphere colliders, falling back to per-rod stepping");
+        setBatchKernel(false);
+    }
+    if (batchKernel && (solver != Solver::DER || hairCollisions)) {
+        spdlog::warn("Batch rod kernel only supports DER without hair collisions, falling back to per-rod stepping");
+        setBatchKernel(false);
+    }
     scene->voxelGrid->initVoxelGrid();
+    if (batchKernel) {
+        TakeBatchStep(dt);
+        return;
+    }
+    if (solver == Solver::XPBD) {
+        TakeXPBDStep(dt);
+        return;
+    }
     // Integrate the physics here
-    std::for_each(std::execution::par_unseq, scene->rods.begin(), scene->rods.end(), [&](ElasticRod &rod)
-    { 
-        rod.integrateFwEuler(dt);
+    RunRodTasks(dt, [&](auto &rod)
+    {
+        rod.wakeOnContact(movedColliders);
+        if (rod.sleeping()) {
+            return;
+        }
+        if (integrator == Integrator::ImplicitEuler) {
+            rod.integrateImplicitEuler(dt);
+        } else {
+            rod.integrateFwEuler(dt);
+        }
+        rod.enforceConstraints(dt, colliders);
+    },
+    [&](auto &rod)
+    {
+        rod.updateAllVelocitiesFromVoxels(scene->voxelGrid, dt);
     });
+}
+
+void PhysicsIntegrator::TakeXPBDStep(float dt)
+{
+    RunRodTasks(dt, [&](auto &rod)
+    {
+        rod.wakeOnContact(movedColliders);
+        if (!rod.sleeping()) {
+            rod.integrateXPBD(dt, colliders);
+        }
+    },
+    [&](auto &rod)
+    {
+        rod.updateAllVelocitiesFromVoxels(scene->voxelGrid, dt, 1.0f);
+    });
+}
+
+template <typename Step, typename Gather>
+void PhysicsIntegrator::RunRodTasks(float dt, const Step& step, const Gather& gather)
+{
+    auto& rods = scene->rods;
+    if (plannedRods != rods.size()) {
+        PlanRodTasks();
+    }
 
-    std::for_each(std::execution::par_unseq, scene->rods.begin(), scene->rods.end(), [&](ElasticRod &rod)
+    std::array<std::atomic<int>, VoxelGrid::splatChunks> pending;
+    for (auto& count : pending) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    for (const RodTask& task : rodTasks) {
+        pending[task.chunk].fetch_add(1, std::memory_order_relaxed);
+    }
+    const bool fuseSplat = !hairCollisions;
+
+    // Tasks synchronize on pending, so this runs par rather than par_unseq
+    std::for_each(std::execution::par, rodTasks.begin(), rodTasks.end(), [&](const RodTask& task)
     {
-        rod.enforceConstraints(dt, scene->sceneObjects);
+        for (size_t r = task.begin; r < task.end; r++) {
+            step(rods[r]);
+        }
+        // The last task of a chunk to finish sees every rod of it stepped. Rods splat in
+        // order within the chunk, so voxel sums do not depend on which task that is.
+        if (fuseSplat && pending[task.chunk].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            const size_t end = VoxelGrid::chunkBegin(task.chunk + 1, rods.size());
+            for (size_t r = VoxelGrid::chunkBegin(task.chunk, rods.size()); r < end; r++) {
+                rods[r].setVoxelContributions(scene->voxelGrid, task.chunk);
+            }
+        }
     });
 
-    std::for_each(std::execution::par_unseq, scene->rods.begin(), scene->rods.end(), [&](ElasticRod &rod)
+    if (fuseSplat) {
+        scene->voxelGrid->reduceSplats();
+    } else {
+        hairCollision.resolve(rods, dt);
+        SplatRods();
+    }
+
+    std::for_each(std::execution::par_unseq, rodTasks.begin(), rodTasks.end(), [&](const RodTask& task)
     {
-        rod.setVoxelContributions(scene->voxelGrid);
+        for (size_t r = task.begin; r < task.end; r++) {
+            gather(rods[r]);
+        }
     });
+}
+
+void PhysicsIntegrator::PlanRodTasks()
+{
+    const size_t numRods = scene->rods.size();
+    const size_t rodsPerTask = std::max<size_t>(rodTaskBytes / sizeof(scene->rods[0]), 1);
+    rodTasks.clear();
+    for (int chunk = 0; chunk < VoxelGrid::splatChunks; chunk++) {
+        const size_t end = VoxelGrid::chunkBegin(chunk + 1, numRods);
+        for (size_t begin = VoxelGrid::chunkBegin(chunk, numRods); begin < end; begin += rodsPerTask) {
+            rodTasks.push_back({chunk, begin, std::min(begin + rodsPerTask, end)});
+        }
+    }
+    plannedRods = numRods;
+}
 
-    std::for_each(std::execution::par_unseq, scene->rods.begin(), scene->rods.end(), [&](ElasticRod &rod)
+void PhysicsIntegrator::SplatRods()
+{
+    std::vector<int> chunks(VoxelGrid::splatChunks);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    // Splatting grows the chunk tables, so par rather than par_unseq
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](int chunk)
     {
-        rod.updateAllVelocitiesFromVoxels(scene->voxelGrid);
+        const size_t end = VoxelGrid::chunkBegin(chunk + 1, scene->rods.size());
+        for (size_t r = VoxelGrid::chunkBegin(chunk, scene->rods.size()); r < end; r++) {
+            scene->rods[r].setVoxelContributions(scene->voxelGrid, chunk);
+        }
     });
+    scene->voxelGrid->reduceSplats();
+}
+
+void PhysicsIntegrator::WakeAll()
+{
+    for (auto& rod : scene->rods) {
+        rod.wake();
+    }
+}
+
+rodkernels::StepParams PhysicsIntegrator::BatchStepParams(float dt) const
+{
+    rodkernels::StepParams params;
+    params.dt = dt;
+    params.gravity[0] = ElasticRodBase::gravity.x();
+    params.gravity[1] = ElasticRodBase::gravity.y();
+    params.gravity[2] = ElasticRodBase::gravity.z();
+    params.drag = ElasticRodBase::drag;
+    params.inextensibility = ElasticRodBase::inextensibility;
+    params.bendingStiffness = scene->rods.empty() ? 1.0f : scene->rods[0].bendingStiffness();
+    params.implicit = integrator == Integrator::ImplicitEuler;
+    params.stretchStiffness = ElasticRodBase::stretchStiffness;
+    params.twistingModulus = ElasticRodBase::beta;
+    params.twistIterations = ElasticRodBase::quasiStaticTwist ? ElasticRodBase::twistIterations : 0;
+    return params;
+}
 
-    
-    
+void PhysicsIntegrator::TakeBatchStep(float dt)
+{
+    rodkernels::StepParams params = BatchStepParams(dt);
+    params.spheres = spheres.data();
+    params.numSpheres = spheres.size() / 4;
+
+    rodkernels::step(scene->rodBatch, params, isa);
+    scene->rodBatch.setVoxelContributions(scene->voxelGrid);
+    scene->rodBatch.updateAllVelocitiesFromVoxels(scene->voxelGrid, dt);
+}
+
+float PhysicsIntegrator::CheckBatchParity(int steps)
+{
+    auto rods = scene->rods;
+    RodBatch batch;
+    batch.init(rods);
+    const rodkernels::StepParams params = BatchStepParams(dt);
+    const ColliderSet none;
+    for (int i = 0; i < steps; i++) {
+        rodkernels::step(batch, params, isa);
+        std::for_each(std::execution::par, rods.begin(), rods.end(), [&](auto& rod)
+        {
+            if (integrator == Integrator::ImplicitEuler) {
+                rod.integrateImplicitEuler(dt);
+            } else {
+                rod.integrateFwEuler(dt);
+            }
+            rod.enforceConstraints(dt, none);
+        });
+    }
+    float maxDiff = 0.0f;
+    for (size_t r = 0; r < rods.size(); r++) {
+        for (size_t i = 0; i < batch.numVerts(); i++) {
+            maxDiff = std::max(maxDiff, (rods[r].x[i] - batch.x(r, i)).norm());
+        }
+    }
+    spdlog::info("Batch kernel ({}) parity over {} steps of {} rods: largest vertex difference {:.3g}",
+                 rodkernels::isaName(isa), steps, rods.size(), maxDiff);
+    return maxDiff;
 }
@@ -1,16 +1,33 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <Scene.hpp>
 #include <Logging.hpp>
 #include <ElasticRod.hpp>
+#include <RodKernels.hpp>
+#include <HairCollision.hpp>
 
 class PhysicsIntegrator
 {
 
 public:
+    // Time integration scheme used for per-rod stepping
+    enum class Integrator { ForwardEuler, ImplicitEuler };
+    // Rod model: discrete elastic rods, or XPBD constraints with follow-the-leader projection
+    enum class Solver { DER, XPBD };
 
     void Initialize();
     void Integrate();
+    /*
+    * Advances the simulation by elapsed seconds of wall time: one Integrate() for every
+    * 1 / tickRate seconds, so simulated speed does not depend on how often this is
+    * called. Each tick is published to the hair mesh stamped with the wall time it was
+    * due at, given now. Runs at most maxCatchUp ticks and drops the time beyond them
+    * rather than falling further behind. Returns the number of ticks run.
+    */
+    int Advance(float elapsed, std::chrono::steady_clock::time_point now);
 
     std::shared_ptr<Scene> scene;
 
@@ -19,10 +36,132 @@ public:
     void setDt(float dt) { this->dt = std::max(dt,0.00001f); }
     int getNumSteps() const { return numSteps; }
     void setNumSteps(int numSteps) { this->numSteps = std::max(numSteps, 1); }
+    float getTickRate() const { return tickRate; }
+    // Ticks per wall second, each advancing dt * numSteps of simulated time
+    void setTickRate(float tickRate) { this->tickRate = std::max(tickRate, 1.0f); }
+    int getMaxCatchUp() const { return maxCatchUp; }
+    void setMaxCatchUp(int maxCatchUp) { this->maxCatchUp = std::max(maxCatchUp, 1); }
+    // Wall time from the last Advance() call until the next tick is due
+    float getTimeToNextTick() const { return std::max(1.0f / tickRate - accumulator, 0.0f); }
+    bool getBatchKernel() const { return batchKernel; }
+    // Switches between per-rod stepping and the cross-rod SIMD kernels on Scene::rodBatch
+    void setBatchKernel(bool enabled);
+    rodkernels::ISA getISA() const { return isa; }
+    /*
+    * Steps copies of the rods steps times both per rod and with the batch kernel, with
+    * the current integrator and without colliders or voxel coupling, and returns the
+    * largest distance between a vertex on the two paths. The scene is left untouched.
+    */
+    float CheckBatchParity(int steps);
+    Integrator getIntegrator() const { return integrator; }
+    void setIntegrator(Integrator integrator) { this->integrator = integrator; }
+    Solver getSolver() const { return solver; }
+    void setSolver(Solver solver) { this->solver = solver; }
+    bool getAdaptiveSteps() const { return adaptiveSteps; }
+    // Lets Integrate() pick the substep count each frame, the frame still advances dt * numSteps
+    void setAdaptiveSteps(bool enabled) { adaptiveSteps = enabled; }
+    int getMaxSteps() const { return maxSteps; }
+    void setMaxSteps(int maxSteps) { this->maxSteps = std::max(maxSteps, 1); }
+    float getTargetMotion() const { return targetMotion; }
+    void setTargetMotion(float targetMotion) { this->targetMotion = std::max(targetMotion, 0.001f); }
+    float getFrameBudget() const { return frameBudget; }
+    void setFrameBudget(float frameBudget) { this->frameBudget = std::max(frameBudget, 0.0f); }
+    // Substeps taken by the last Integrate() call
+    int getLastStepCount() const { return lastStepCount; }
+    // Rods that skipped integration at the end of the last Integrate() call
+    int getSleepingRods() const { return sleepingRods; }
+    // Voxels the rods occupied at the end of the last Integrate() call
+    size_t getOccupiedVoxels() const { return occupiedVoxels; }
+    // Wakes every rod, for changes that affect settled hair such as gravity or stiffness
+    void WakeAll();
+    // Rolling average wall time of one TakeStep in seconds, for each solver that has run
+    float getAvgStepTime(Solver solver) const { return avgStepTimes[(int)solver]; }
+    bool getHairCollisions() const { return hairCollisions; }
+    // Enables strand-strand contact after the rod constraints of every step
+    void setHairCollisions(bool enabled) { hairCollisions = enabled; }
+    bool getContinuousCollisions() const { return continuousCollisions; }
+    // Sweeps colliders across the substeps of a frame and tests hair along its motion,
+    // rather than only where both end up, so fast props do not tunnel through hair
+    void setContinuousCollisions(bool enabled) { continuousCollisions = enabled; }
+    // Parameters, timings and contact counts of the hair-hair collision stage
+    HairCollision& getHairCollision() { return hairCollision; }
 
 private:
     void TakeStep(float dt);
+    void TakeBatchStep(float dt);
+    // Kernel parameters for a step of dt with the current rod constants, without colliders
+    rodkernels::StepParams BatchStepParams(float dt) const;
+    void TakeXPBDStep(float dt);
+    // Splats every rod into the voxel grid, one contiguous range of rods per grid chunk
+    void SplatRods();
+    // Rods [begin, end) of splat chunk chunk
+    struct RodTask
+    {
+        int chunk;
+        size_t begin;
+        size_t end;
+    };
+    /*
+    * Runs a substep as a task graph over rodTasks rather than a parallel sweep per
+    * stage: a task runs step on each of its rods and the last task of a splat chunk to
+    * finish splats the whole chunk, so rods are stepped and splatted while cached. The
+    * one barrier left is the voxel reduction that gather, run per task, depends on.
+    * Hair collisions couple rods of any chunk, with them the splat waits for every
+    * step and the collision pass.
+    */
+    template <typename Step, typename Gather>
+    void RunRodTasks(float dt, const Step& step, const Gather& gather);
+    // Cuts every splat chunk into tasks of about rodTaskBytes of rod state
+    void PlanRodTasks();
+    // Substep count that keeps rod and collider motion per step under targetMotion,
+    // limited by maxSteps and by how many steps fit in frameBudget. Forward Euler
+    // takes at least numSteps, so its steps are never longer than dt.
+    int AdaptiveStepCount();
+    // Packs the scene's colliders for substep step of steps, and separately those that
+    // move during it. With continuous collisions a collider moves from its center at
+    // the end of the last frame to its current one over the frame, otherwise it is at
+    // its current center from the first substep on.
+    void UpdateColliders(int step, int steps);
+    // Packs sphere colliders for the batch kernel, false if any collider is not a sphere
+    // or is scaled unevenly
+    bool PackSphereColliders();
     float dt = 0.045;
     int numSteps = 5;
+    float tickRate = 60.0f;
+    int maxCatchUp = 4;
+    // Wall time not simulated yet, under one tick after Advance()
+    float accumulator = 0.0f;
+    // TakeStep() clears it on fallback while the GUI reads it, so atomic
+    std::atomic<bool> batchKernel = false;
+    Integrator integrator = Integrator::ImplicitEuler;
+    Solver solver = Solver::DER;
+    bool adaptiveSteps = false;
+    int maxSteps = 20;
+    // Allowed vertex motion per step, in rest edge lengths
+    float targetMotion = 0.1f;
+    // Wall time in seconds the substeps of one frame may take
+    float frameBudget = 0.012f;
+    // Statistics written while stepping and read by the GUI, so atomic
+    std::array<std::atomic<float>, 2> avgStepTimes = {};
+    std::atomic<int> lastStepCount = 5;
+    std::atomic<int> sleepingRods = 0;
+    std::atomic<size_t> occupiedVoxels = 0;
+    bool hairCollisions = false;
+    bool continuousCollisions = true;
+    HairCollision hairCollision;
+    // Collider centers at the end of the previous frame, for collider motion
+    std::vector<Vector3f> colliderCenters;
+    // Every collider of the scene, packed by type for the rods' collision queries
+    ColliderSet colliders;
+    // Colliders that move during this step, only these can wake sleeping rods
+    ColliderSet movedColliders;
+    // Rod state per task, a share of L2 that still fits when cores share theirs
+    static constexpr size_t rodTaskBytes = 256 * 1024;
+    std::vector<RodTask> rodTasks;
+    // Rod count rodTasks were planned for
+    size_t plannedRods = 0;
+    rodkernels::ISA isa = rodkernels::ISA::Scalar;
+    // Sphere colliders as (x, y, z, radius)
+    std::vector<float> spheres;
 };
 
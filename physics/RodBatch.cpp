@@ -0,0 +1,115 @@
+#include <RodBatch.hpp>
+#include <ElasticRod.hpp>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <cassert>
+
+template <int N>
+void RodBatch::init(const std::vector<ElasticRod<N>>& rods)
+{
+    rodCount = rods.size();
+    vertCount = rods.empty() ? 0 : rods[0].x.size();
+    rowStride = ((rodCount + packetWidth - 1) / packetWidth) * packetWidth;
+
+    const size_t n = vertCount * rowStride;
+    for (std::vector<float>* a : {&px, &py, &pz, &vx, &vy, &vz, &rx, &ry, &rz,
+                                  &ux, &uy, &uz, &wx, &wy, &wz, &theta,
+                                  &restLen, &o0x, &o0y, &o1x, &o1y}) {
+        a->assign(n, 0.0f);
+    }
+    for (std::vector<float>* a : {&ex, &ey, &ez}) {
+        a->assign(rowStride, 0.0f);
+    }
+
+    for (size_t r = 0; r < rodCount; r++) {
+        assert(rods[r].x.size() == vertCount);
+        rods[r].storeRest(rod(r));
+        for (size_t i = 0; i < vertCount; i++) {
+            const size_t e = std::min(i, vertCount - 2);
+            restLen[index(r, i)] = (xRest(r, e + 1) - xRest(r, e)).norm();
+        }
+    }
+    gather(rods);
+    padLanes();
+}
+
+void RodBatch::padLanes()
+{
+    if (rodCount == 0) {
+        return;
+    }
+    for (std::vector<float>* a : {&px, &py, &pz, &vx, &vy, &vz, &rx, &ry, &rz,
+                                  &ux, &uy, &uz, &wx, &wy, &wz, &theta,
+                                  &restLen, &o0x, &o0y, &o1x, &o1y}) {
+        for (size_t i = 0; i < vertCount; i++) {
+            std::fill(a->begin() + index(rodCount, i), a->begin() + index(0, i + 1), (*a)[index(0, i)]);
+        }
+    }
+    for (std::vector<float>* a : {&ex, &ey, &ez}) {
+        std::fill(a->begin() + rodCount, a->end(), (*a)[0]);
+    }
+}
+
+template <int N>
+void RodBatch::gather(const std::vector<ElasticRod<N>>& rods)
+{
+    assert(rods.size() == rodCount);
+    std::for_each(std::execution::par_unseq, rods.begin(), rods.end(), [&](const ElasticRod<N>& rod)
+    {
+        rod.store(this->rod(&rod - rods.data()));
+    });
+}
+
+template <int N>
+void RodBatch::scatter(std::vector<ElasticRod<N>>& rods)
+{
+    assert(rods.size() == rodCount);
+    std::for_each(std::execution::par_unseq, rods.begin(), rods.end(), [&](ElasticRod<N>& rod)
+    {
+        rod.load(this->rod(&rod - rods.data()));
+    });
+}
+
+void RodBatch::setVoxelContributions(const std::shared_ptr<VoxelGrid>& voxelGrid)
+{
+    std::vector<int> chunks(VoxelGrid::splatChunks);
+    std::iota(chunks.begin(), chunks.end(), 0);
+    // Splatting grows the chunk tables, so par rather than par_unseq
+    std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](int chunk)
+    {
+        const size_t end = VoxelGrid::chunkBegin(chunk + 1, rodCount);
+        for (size_t r = VoxelGrid::chunkBegin(chunk, rodCount); r < end; r++) {
+            for (size_t i = 1; i < vertCount; i++) {
+                voxelGrid->splat(chunk, x(r, i), v(r, i));
+            }
+        }
+    });
+    voxelGrid->reduceSplats();
+}
+
+void RodBatch::updateAllVelocitiesFromVoxels(const std::shared_ptr<VoxelGrid>& voxelGrid, float dt)
+{
+    const float friction = ElasticRodBase::friction;
+    // Gathers one vertex row across all rods at a time
+    std::vector<Eigen::Vector3f> positions(rodCount), velocities(rodCount), densityGradients(rodCount);
+    std::vector<float> densities(rodCount);
+    for (size_t i = 1; i < vertCount; i++) {
+        for (size_t r = 0; r < rodCount; r++) {
+            positions[r] = x(r, i);
+        }
+        voxelGrid->sampleVelocities(positions.data(), rodCount, velocities.data(), densities.data(), densityGradients.data());
+        for (size_t r = 0; r < rodCount; r++) {
+            const Eigen::Vector3f velocity = velocities[r] * ElasticRodBase::sampledVelocityScale;
+            setV(r, i, (1 - friction) * v(r, i) + friction * velocity +
+                       dt * ElasticRodBase::volumeAcceleration(densities[r], densityGradients[r]));
+        }
+    }
+}
+
+template void RodBatch::init(const std::vector<ElasticRod<Dynamic>>& rods);
+template void RodBatch::gather(const std::vector<ElasticRod<Dynamic>>& rods);
+template void RodBatch::scatter(std::vector<ElasticRod<Dynamic>>& rods);
+template void RodBatch::init(const std::vector<ElasticRod<HairMesh::controlHairLen>>& rods);
+template void RodBatch::gather(const std::vector<ElasticRod<HairMesh::controlHairLen>>& rods);
+template void RodBatch::scatter(std::vector<ElasticRod<HairMesh::controlHairLen>>& rods);
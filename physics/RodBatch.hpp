@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <Eigen/Dense>
+
+template <int N> class ElasticRod;
+class VoxelGrid;
+
+// Structure-of-arrays storage for a set of equal length rods. Vertex i of
+// every rod is laid out contiguously, so component c of (rod, i) lives at
+// c[i * stride() + rod] and a packet of neighbouring rods can be loaded
+// with a single vector load.
+class RodBatch
+{
+public:
+    // Rows are padded to a multiple of this many rods
+    static constexpr size_t packetWidth = 16;
+
+    // Per-rod accessor mirroring ElasticRod's x / v / xRest members, so code
+    // written against a single rod can be moved over to the batch gradually
+    class View
+    {
+    public:
+        View(RodBatch& batch, size_t rod) : batch(&batch), rod(rod) {}
+
+        size_t size() const { return batch->numVerts(); }
+        size_t index() const { return rod; }
+
+        Eigen::Vector3f x(size_t i) const { return batch->x(rod, i); }
+        Eigen::Vector3f v(size_t i) const { return batch->v(rod, i); }
+        Eigen::Vector3f xRest(size_t i) const { return batch->xRest(rod, i); }
+        Eigen::Vector3f frameU(size_t i) const { return batch->frameU(rod, i); }
+        Eigen::Vector3f frameV(size_t i) const { return batch->frameV(rod, i); }
+        Eigen::Vector3f rootEdge() const { return batch->rootEdge(rod); }
+        float theta(size_t i) const { return batch->theta[batch->index(rod, i)]; }
+
+        void setX(size_t i, const Eigen::Vector3f& value) { batch->setX(rod, i, value); }
+        void setV(size_t i, const Eigen::Vector3f& value) { batch->setV(rod, i, value); }
+        void setFrame(size_t i, const Eigen::Vector3f& u, const Eigen::Vector3f& v) { batch->setFrame(rod, i, u, v); }
+        void setRootEdge(const Eigen::Vector3f& value) { batch->setRootEdge(rod, value); }
+        void setTheta(size_t i, float value) { batch->theta[batch->index(rod, i)] = value; }
+        void setXRest(size_t i, const Eigen::Vector3f& value) { batch->setXRest(rod, i, value); }
+        void setRestCurvature(size_t i, const Eigen::Vector2f& prev, const Eigen::Vector2f& next) { batch->setRestCurvature(rod, i, prev, next); }
+    private:
+        RodBatch* batch;
+        size_t rod;
+    };
+
+    // Allocates storage for the given rods and copies their state in
+    template <int N>
+    void init(const std::vector<ElasticRod<N>>& rods);
+    // Copies the current state of every rod into the batch
+    template <int N>
+    void gather(const std::vector<ElasticRod<N>>& rods);
+    // Copies the batch state back into every rod
+    template <int N>
+    void scatter(std::vector<ElasticRod<N>>& rods);
+
+    // Same as ElasticRod::setVoxelContributions, for every rod in the batch
+    void setVoxelContributions(const std::shared_ptr<VoxelGrid>& voxelGrid);
+    // Same as ElasticRod::updateAllVelocitiesFromVoxels, for every rod in the batch
+    void updateAllVelocitiesFromVoxels(const std::shared_ptr<VoxelGrid>& voxelGrid, float dt);
+
+    View rod(size_t r) { return View(*this, r); }
+
+    inline size_t numRods() const { return rodCount; }
+    inline size_t numVerts() const { return vertCount; }
+    // Distance between vertex rows, numRods() rounded up to packetWidth
+    inline size_t stride() const { return rowStride; }
+    inline size_t index(size_t rod, size_t i) const { return i * rowStride + rod; }
+
+    Eigen::Vector3f x(size_t rod, size_t i) const { return load(px, py, pz, index(rod, i)); }
+    Eigen::Vector3f v(size_t rod, size_t i) const { return load(vx, vy, vz, index(rod, i)); }
+    Eigen::Vector3f xRest(size_t rod, size_t i) const { return load(rx, ry, rz, index(rod, i)); }
+    Eigen::Vector3f frameU(size_t rod, size_t i) const { return load(ux, uy, uz, index(rod, i)); }
+    Eigen::Vector3f frameV(size_t rod, size_t i) const { return load(wx, wy, wz, index(rod, i)); }
+    Eigen::Vector3f rootEdge(size_t rod) const { return load(ex, ey, ez, rod); }
+
+    void setX(size_t rod, size_t i, const Eigen::Vector3f& value) { store(px, py, pz, index(rod, i), value); }
+    void setV(size_t rod, size_t i, const Eigen::Vector3f& value) { store(vx, vy, vz, index(rod, i), value); }
+    void setFrame(size_t rod, size_t i, const Eigen::Vector3f& u, const Eigen::Vector3f& v)
+    {
+        store(ux, uy, uz, index(rod, i), u);
+        store(wx, wy, wz, index(rod, i), v);
+    }
+    void setRootEdge(size_t rod, const Eigen::Vector3f& value) { store(ex, ey, ez, rod, value); }
+    void setXRest(size_t rod, size_t i, const Eigen::Vector3f& value) { store(rx, ry, rz, index(rod, i), value); }
+    void setRestCurvature(size_t rod, size_t i, const Eigen::Vector2f& prev, const Eigen::Vector2f& next)
+    {
+        const size_t idx = index(rod, i);
+        o0x[idx] = prev.x();
+        o0y[idx] = prev.y();
+        o1x[idx] = next.x();
+        o1y[idx] = next.y();
+    }
+
+    // Positions
+    std::vector<float> px, py, pz;
+    // Velocities
+    std::vector<float> vx, vy, vz;
+    // Rest positions
+    std::vector<float> rx, ry, rz;
+    // Bishop frame (u, v) of each edge
+    std::vector<float> ux, uy, uz;
+    std::vector<float> wx, wy, wz;
+    // Twist of the material frames against the bishop frames
+    std::vector<float> theta;
+    // Edge 0 the root frame was last transported to, a single row
+    std::vector<float> ex, ey, ez;
+    // Rest edge lengths, the last row repeats the final edge
+    std::vector<float> restLen;
+    // Rest material curvature of vertex i against frames i-1 (o0) and i (o1)
+    std::vector<float> o0x, o0y, o1x, o1y;
+private:
+    // Fills the padding lanes of every row with rod 0, so they stay well formed
+    void padLanes();
+
+    static Eigen::Vector3f load(const std::vector<float>& a, const std::vector<float>& b,
+                                const std::vector<float>& c, size_t idx)
+    {
+        return {a[idx], b[idx], c[idx]};
+    }
+    static void store(std::vector<float>& a, std::vector<float>& b,
+                      std::vector<float>& c, size_t idx, const Eigen::Vector3f& value)
+    {
+        a[idx] = value.x();
+        b[idx] = value.y();
+        c[idx] = value.z();
+    }
+
+    size_t rodCount = 0;
+    size_t vertCount = 0;
+    size_t rowStride = 0;
+};
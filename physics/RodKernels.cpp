@@ -0,0 +1,125 @@
+#include <RodKernels.hpp>
+#include <RodKernelsImpl.hpp>
+#include <RodBatch.hpp>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <cmath>
+
+#if RODKERNELS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // Single lane pack, the portable fallback
+    struct Pack
+    {
+        using Mask = bool;
+        float v;
+
+        static Pack set(float s) { return {s}; }
+        static Pack load(const float* p) { return {*p}; }
+        void store(float* p) const { *p = v; }
+    };
+
+    inline Pack operator+(Pack a, Pack b) { return {a.v + b.v}; }
+    inline Pack operator-(Pack a, Pack b) { return {a.v - b.v}; }
+    inline Pack operator*(Pack a, Pack b) { return {a.v * b.v}; }
+    inline Pack operator/(Pack a, Pack b) { return {a.v / b.v}; }
+    inline Pack operator-(Pack a) { return {-a.v}; }
+    inline bool operator<(Pack a, Pack b) { return a.v < b.v; }
+    inline bool operator>(Pack a, Pack b) { return a.v > b.v; }
+    inline Pack sqrt(Pack a) { return {std::sqrt(a.v)}; }
+    inline Pack select(bool m, Pack a, Pack b) { return m ? a : b; }
+}
+
+namespace rodkernels
+{
+
+void stepPacketScalar(const BatchRef& batch, const StepParams& params, size_t firstRod)
+{
+    detail::stepPacket<Pack>(batch, params, firstRod);
+}
+
+ISA detectISA()
+{
+#if RODKERNELS_X86 && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return ISA::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return ISA::AVX2;
+    }
+#elif RODKERNELS_X86 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    __cpuidex(info, 7, 0);
+    if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) {
+        return ISA::AVX512;
+    }
+    if ((info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6) {
+        return ISA::AVX2;
+    }
+#endif
+    return ISA::Scalar;
+}
+
+const char* isaName(ISA isa)
+{
+    switch (isa) {
+        case ISA::AVX512: return "AVX-512";
+        case ISA::AVX2: return "AVX2";
+        default: return "Scalar";
+    }
+}
+
+size_t laneWidth(ISA isa)
+{
+    switch (isa) {
+        case ISA::AVX512: return 16;
+        case ISA::AVX2: return 8;
+        default: return 1;
+    }
+}
+
+void step(RodBatch& batch, const StepParams& params, ISA isa)
+{
+    if (batch.numRods() == 0) {
+        return;
+    }
+    const BatchRef ref = {
+        batch.px.data(), batch.py.data(), batch.pz.data(),
+        batch.vx.data(), batch.vy.data(), batch.vz.data(),
+        batch.ux.data(), batch.uy.data(), batch.uz.data(),
+        batch.wx.data(), batch.wy.data(), batch.wz.data(),
+        batch.ex.data(), batch.ey.data(), batch.ez.data(),
+        batch.theta.data(),
+        batch.rx.data(), batch.ry.data(), batch.rz.data(),
+        batch.restLen.data(),
+        batch.o0x.data(), batch.o0y.data(), batch.o1x.data(), batch.o1y.data(),
+        batch.numVerts(), batch.stride()
+    };
+
+    void (*kernel)(const BatchRef&, const StepParams&, size_t) = stepPacketScalar;
+#if RODKERNELS_X86
+    if (isa == ISA::AVX512) {
+        kernel = stepPacketAVX512;
+    } else if (isa == ISA::AVX2) {
+        kernel = stepPacketAVX2;
+    }
+#endif
+    const size_t width = laneWidth(isa);
+    std::vector<size_t> packets((batch.numRods() + width - 1) / width);
+    std::iota(packets.begin(), packets.end(), 0);
+    std::for_each(std::execution::par, packets.begin(), packets.end(), [&](size_t packet)
+    {
+        kernel(ref, params, packet * width);
+    });
+}
+
+} // namespace rodkernels
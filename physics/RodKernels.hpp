@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RODKERNELS_X86 1
+#else
+#define RODKERNELS_X86 0
+#endif
+
+class RodBatch;
+
+// Cross-rod packet kernels for RodBatch. Vertex i of W neighbouring rods is
+// processed as one W-wide vector, W depending on the instruction set picked
+// at runtime. Every ISA runs the same kernel body with plain IEEE operations
+// (no FMA contraction, no approximate reciprocals), so the scalar fallback
+// gives bitwise identical results.
+namespace rodkernels
+{
+    enum class ISA { Scalar, AVX2, AVX512 };
+
+    struct StepParams
+    {
+        float dt = 0.0f;
+        float gravity[3] = {0.0f, 0.0f, 0.0f};
+        float drag = 0.0f;
+        float inextensibility = 0.0f;
+        float bendingStiffness = 1.0f;
+        // Linearized backward Euler instead of forward Euler, with the edge
+        // stiffness of ElasticRodBase::stretchStiffness
+        bool implicit = false;
+        float stretchStiffness = 0.0f;
+        float twistingModulus = 1.0f;
+        // Newton iterations of the quasi-static twist solve, 0 keeps theta as it is
+        int twistIterations = 0;
+        // Sphere colliders packed as (x, y, z, radius)
+        const float* spheres = nullptr;
+        size_t numSpheres = 0;
+    };
+
+    // Raw view of the batch arrays handed to the packet kernels
+    struct BatchRef
+    {
+        float *px, *py, *pz;
+        float *vx, *vy, *vz;
+        float *ux, *uy, *uz;
+        float *wx, *wy, *wz;
+        float *ex, *ey, *ez;
+        float *theta;
+        const float *rx, *ry, *rz;
+        const float *restLen;
+        const float *o0x, *o0y, *o1x, *o1y;
+        size_t numVerts;
+        size_t stride;
+    };
+
+    // Best instruction set supported by this CPU and build
+    ISA detectISA();
+    const char* isaName(ISA isa);
+    // Number of rods processed per packet
+    size_t laneWidth(ISA isa);
+
+    // integrateFwEuler or integrateImplicitEuler, then enforceConstraints, for every rod of the batch
+    void step(RodBatch& batch, const StepParams& params, ISA isa);
+
+    // Per-ISA packet entry points, each handles laneWidth() rods from firstRod
+    void stepPacketScalar(const BatchRef& batch, const StepParams& params, size_t firstRod);
+#if RODKERNELS_X86
+    void stepPacketAVX2(const BatchRef& batch, const StepParams& params, size_t firstRod);
+    void stepPacketAVX512(const BatchRef& batch, const StepParams& params, size_t firstRod);
+#endif
+};
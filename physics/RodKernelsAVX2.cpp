@@ -0,0 +1,40 @@
+// Compiled with AVX2 enabled, see CMakeLists.txt
+#include <RodKernels.hpp>
+
+#if RODKERNELS_X86
+#include <immintrin.h>
+#include <RodKernelsImpl.hpp>
+
+namespace
+{
+    struct Pack
+    {
+        using Mask = __m256;
+        __m256 v;
+
+        static Pack set(float s) { return {_mm256_set1_ps(s)}; }
+        static Pack load(const float* p) { return {_mm256_loadu_ps(p)}; }
+        void store(float* p) const { _mm256_storeu_ps(p, v); }
+    };
+
+    inline Pack operator+(Pack a, Pack b) { return {_mm256_add_ps(a.v, b.v)}; }
+    inline Pack operator-(Pack a, Pack b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    inline Pack operator*(Pack a, Pack b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    inline Pack operator/(Pack a, Pack b) { return {_mm256_div_ps(a.v, b.v)}; }
+    inline Pack operator-(Pack a) { return {_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))}; }
+    inline __m256 operator<(Pack a, Pack b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    inline __m256 operator>(Pack a, Pack b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    inline Pack sqrt(Pack a) { return {_mm256_sqrt_ps(a.v)}; }
+    inline Pack select(__m256 m, Pack a, Pack b) { return {_mm256_blendv_ps(b.v, a.v, m)}; }
+}
+
+namespace rodkernels
+{
+
+void stepPacketAVX2(const BatchRef& batch, const StepParams& params, size_t firstRod)
+{
+    detail::stepPacket<Pack>(batch, params, firstRod);
+}
+
+} // namespace rodkernels
+#endif
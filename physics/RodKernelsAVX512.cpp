@@ -0,0 +1,44 @@
+// Compiled with AVX-512F enabled, see CMakeLists.txt
+#include <RodKernels.hpp>
+
+#if RODKERNELS_X86
+#include <immintrin.h>
+#include <RodKernelsImpl.hpp>
+
+namespace
+{
+    struct Pack
+    {
+        using Mask = __mmask16;
+        __m512 v;
+
+        static Pack set(float s) { return {_mm512_set1_ps(s)}; }
+        static Pack load(const float* p) { return {_mm512_loadu_ps(p)}; }
+        void store(float* p) const { _mm512_storeu_ps(p, v); }
+    };
+
+    inline Pack operator+(Pack a, Pack b) { return {_mm512_add_ps(a.v, b.v)}; }
+    inline Pack operator-(Pack a, Pack b) { return {_mm512_sub_ps(a.v, b.v)}; }
+    inline Pack operator*(Pack a, Pack b) { return {_mm512_mul_ps(a.v, b.v)}; }
+    inline Pack operator/(Pack a, Pack b) { return {_mm512_div_ps(a.v, b.v)}; }
+    // Sign flip rather than 0 - a, so -0.0f matches the scalar path
+    inline Pack operator-(Pack a)
+    {
+        return {_mm512_castsi512_ps(_mm512_xor_epi32(_mm512_castps_si512(a.v), _mm512_set1_epi32((int)0x80000000)))};
+    }
+    inline __mmask16 operator<(Pack a, Pack b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+    inline __mmask16 operator>(Pack a, Pack b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+    inline Pack sqrt(Pack a) { return {_mm512_sqrt_ps(a.v)}; }
+    inline Pack select(__mmask16 m, Pack a, Pack b) { return {_mm512_mask_blend_ps(m, b.v, a.v)}; }
+}
+
+namespace rodkernels
+{
+
+void stepPacketAVX512(const BatchRef& batch, const StepParams& params, size_t firstRod)
+{
+    detail::stepPacket<Pack>(batch, params, firstRod);
+}
+
+} // namespace rodkernels
+#endif
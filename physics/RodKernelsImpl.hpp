@@ -0,0 +1,502 @@
+#pragma once
+
+// Shared body of the packet kernels. Each ISA translation unit defines a
+// Pack type (with its operators, sqrt and select) in an anonymous namespace
+// and instantiates stepPacket<Pack>, so every instantiation stays local to
+// the file compiled for that instruction set.
+
+#include <RodKernels.hpp>
+#include <BandedCholesky.hpp>
+#include <vector>
+#include <array>
+#include <algorithm>
+
+namespace rodkernels {
+namespace detail {
+
+template<typename P>
+struct V3
+{
+    P x, y, z;
+};
+
+template<typename P> inline V3<P> operator+(const V3<P>& a, const V3<P>& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+template<typename P> inline V3<P> operator-(const V3<P>& a, const V3<P>& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+template<typename P> inline V3<P> operator-(const V3<P>& a) { return {-a.x, -a.y, -a.z}; }
+template<typename P> inline V3<P> operator*(const V3<P>& a, const P& s) { return {a.x * s, a.y * s, a.z * s}; }
+template<typename P> inline V3<P> operator/(const V3<P>& a, const P& s) { return {a.x / s, a.y / s, a.z / s}; }
+
+template<typename P> inline P& component(V3<P>& a, int c)
+{
+    return c == 0 ? a.x : (c == 1 ? a.y : a.z);
+}
+
+template<typename P> inline const P& component(const V3<P>& a, int c)
+{
+    return c == 0 ? a.x : (c == 1 ? a.y : a.z);
+}
+
+template<typename P> inline P dot(const V3<P>& a, const V3<P>& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+template<typename P> inline V3<P> cross(const V3<P>& a, const V3<P>& b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+template<typename P> inline V3<P> select(const typename P::Mask& m, const V3<P>& a, const V3<P>& b)
+{
+    return {select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z)};
+}
+
+// Same as Eigen's normalized(): zero vectors are returned unchanged
+template<typename P> inline V3<P> normalized(const V3<P>& a)
+{
+    const P n2 = dot(a, a);
+    return select(n2 > P::set(0.0f), a / sqrt(n2), a);
+}
+
+// Same as ElasticRod::parallelTransport: rotates u by the minimal rotation
+// taking direction e0 to e1, dropping it onto the new normal plane where the
+// edges are opposite
+template<typename P> inline V3<P> parallelTransport(const V3<P>& e0, const P& len0, const V3<P>& e1, const P& len1, const V3<P>& u)
+{
+    const P one = P::set(1.0f);
+    const P two = P::set(2.0f);
+    const P lens = len0 * len1;
+    const P denom = lens + dot(e0, e1);
+    const typename P::Mask rotate = denom > P::set(1e-6f) * lens;
+    const V3<P> dropped = normalized(u - e1 * (dot(e1, u) / (len1 * len1)));
+    // axis = 2 tan(phi/2) n, so the rotation quaternion is (2, axis) / sqrt(4 + |axis|^2)
+    const V3<P> axis = (cross(e0, e1) * two) / select(rotate, denom, one);
+    const P s = one / sqrt(P::set(4.0f) + dot(axis, axis));
+    const P w = two * s;
+    const V3<P> q = axis * s;
+    const V3<P> t = cross(q, u) * two;
+    return select(rotate, u + t * w + cross(q, t), dropped);
+}
+
+template<typename P> inline P abs(const P& a)
+{
+    return select(a < P::set(0.0f), -a, a);
+}
+
+template<typename P> inline P max(const P& a, const P& b)
+{
+    return select(a > b, a, b);
+}
+
+// sin and cos from + - * only, so every ISA rounds the same way. x is reduced to
+// [-pi, pi], the Taylor polynomials run on x / 2 (error below 6e-8) and the
+// double angle formulas give the result.
+template<typename P> inline void sinCos(const P& x, P& sine, P& cosine)
+{
+    // Adding and subtracting 1.5 * 2^23 rounds to the nearest integer
+    const P round = P::set(12582912.0f);
+    const P turns = (x * P::set(0.159154943f) + round) - round;
+    // 2 pi split in two, so turns * twoPiHi is exact for any reasonable angle
+    const P h = ((x - turns * P::set(6.28125f)) - turns * P::set(0.00193530717f)) * P::set(0.5f);
+    const P h2 = h * h;
+    const P s = h * (P::set(1.0f) + h2 * (P::set(-1.0f / 6.0f) + h2 * (P::set(1.0f / 120.0f) + h2 * (P::set(-1.0f / 5040.0f) +
+                h2 * (P::set(1.0f / 362880.0f) + h2 * P::set(-1.0f / 39916800.0f))))));
+    const P c = P::set(1.0f) + h2 * (P::set(-0.5f) + h2 * (P::set(1.0f / 24.0f) + h2 * (P::set(-1.0f / 720.0f) +
+                h2 * (P::set(1.0f / 40320.0f) + h2 * (P::set(-1.0f / 3628800.0f) + h2 * P::set(1.0f / 479001600.0f))))));
+    sine = P::set(2.0f) * s * c;
+    cosine = c * c - s * s;
+}
+
+template<typename P> inline V3<P> loadV3(const float* x, const float* y, const float* z, size_t idx)
+{
+    return {P::load(x + idx), P::load(y + idx), P::load(z + idx)};
+}
+
+template<typename P> inline void storeV3(float* x, float* y, float* z, size_t idx, const V3<P>& a)
+{
+    a.x.store(x + idx);
+    a.y.store(y + idx);
+    a.z.store(z + idx);
+}
+
+// Half-bandwidth of the implicit system, same as ElasticRod's
+constexpr int hessianBandwidth = 8;
+
+template<typename P>
+struct Scratch
+{
+    std::vector<V3<P>> e, kb, g0, g1, u, v, m1, m2, t0, t1, t2, f, xu, corr, vel, hv;
+    std::vector<P> len, rl, denom, h, theta, twistDiag, twistOff, twistRhs;
+    // Implicit step: lower band of I + dt^2 H, right hand side and its solution
+    std::vector<P> band, rhs, dv;
+
+    void resize(size_t n)
+    {
+        for (std::vector<V3<P>>* a : {&e, &kb, &g0, &g1, &u, &v, &m1, &m2, &t0, &t1, &t2, &f, &xu, &corr, &vel, &hv}) {
+            a->resize(n);
+        }
+        for (std::vector<P>* a : {&len, &rl, &denom, &h, &theta, &twistDiag, &twistOff, &twistRhs}) {
+            a->resize(n);
+        }
+        band.resize(3 * n * (hessianBandwidth + 1));
+        rhs.resize(3 * n);
+        dv.resize(3 * n);
+    }
+};
+
+// One step of W rods starting at firstRod, mirroring ElasticRod::integrateFwEuler
+// or ElasticRod::integrateImplicitEuler followed by ElasticRod::enforceConstraints
+template<typename P>
+void stepPacket(const BatchRef& b, const StepParams& p, size_t firstRod)
+{
+    thread_local Scratch<P> s;
+    const int n = (int)b.numVerts;
+    s.resize(n);
+    auto at = [&](int i) { return (size_t)i * b.stride + firstRod; };
+    // Edge index clamped like ElasticRod::edge()
+    auto ce = [&](int i) { return i < 0 ? 0 : (i > n - 2 ? n - 2 : i); };
+
+    const P zero = P::set(0.0f);
+    const P one = P::set(1.0f);
+    const P two = P::set(2.0f);
+    const P dt = P::set(p.dt);
+    const P stiffness = P::set(p.bendingStiffness);
+    const P twoBeta = P::set(2.0f * p.twistingModulus);
+
+    // Geometry
+    for (int i = 0; i < n - 1; i++) {
+        s.e[i] = loadV3<P>(b.px, b.py, b.pz, at(i + 1)) - loadV3<P>(b.px, b.py, b.pz, at(i));
+        s.len[i] = sqrt(dot(s.e[i], s.e[i]));
+    }
+    for (int i = 0; i < n; i++) {
+        s.rl[i] = P::load(b.restLen + at(i));
+    }
+    // Curvature binormals with the clamped denominator of ElasticRod::compGeometry,
+    // g0 and g1 are its gradients wrt e0 and e1
+    const P minDenomScale = P::set(0.1f);
+    for (int k = 0; k < n; k++) {
+        const V3<P>& e0 = s.e[ce(k - 1)];
+        const V3<P>& e1 = s.e[ce(k)];
+        const P& len0 = s.len[ce(k - 1)];
+        const P& len1 = s.len[ce(k)];
+        const P restDenom = s.rl[ce(k - 1)] * s.rl[ce(k)];
+        const P lens = len0 * len1;
+        const typename P::Mask stretched = restDenom < lens;
+        const P denom = select(stretched, lens, restDenom) + dot(e0, e1);
+        const typename P::Mask clamped = denom < minDenomScale * restDenom;
+        const V3<P> none = {zero, zero, zero};
+        s.g0[k] = select(clamped, none, select(stretched, e1 + e0 * (len1 / len0), e1));
+        s.g1[k] = select(clamped, none, select(stretched, e0 + e1 * (len0 / len1), e0));
+        s.denom[k] = select(clamped, minDenomScale * restDenom, denom);
+        s.kb[k] = (cross(e0, e1) * two) / s.denom[k];
+    }
+
+    // Bishop frames, see ElasticRod::compBishopFrames. The root frame is
+    // carried along with edge 0 since the last step, then renormalized.
+    const V3<P> root = loadV3<P>(b.ex, b.ey, b.ez, firstRod);
+    const V3<P> t0 = s.e[0] / s.len[0];
+    const V3<P> u0 = parallelTransport(root, sqrt(dot(root, root)), s.e[0], s.len[0], loadV3<P>(b.ux, b.uy, b.uz, at(0)));
+    s.u[0] = normalized(u0 - t0 * dot(t0, u0));
+    s.v[0] = cross(t0, s.u[0]);
+    storeV3(b.ex, b.ey, b.ez, firstRod, s.e[0]);
+    for (int i = 1; i < n; i++) {
+        s.u[i] = parallelTransport(s.e[ce(i - 1)], s.len[ce(i - 1)], s.e[ce(i)], s.len[ce(i)], s.u[i - 1]);
+        s.v[i] = cross(s.e[ce(i)] / s.len[ce(i)], s.u[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        storeV3(b.ux, b.uy, b.uz, at(i), s.u[i]);
+        storeV3(b.wx, b.wy, b.wz, at(i), s.v[i]);
+    }
+
+    // Material frames, rotated by theta from the bishop frames. The last frame
+    // stays zero like ElasticRod::M[n-1].
+    auto materialFrames = [&]
+    {
+        for (int i = 0; i < n - 1; i++) {
+            P sine, cosine;
+            sinCos(s.theta[i], sine, cosine);
+            s.m1[i] = s.u[i] * cosine + s.v[i] * sine;
+            s.m2[i] = s.v[i] * cosine - s.u[i] * sine;
+        }
+        s.m1[n - 1] = {zero, zero, zero};
+        s.m2[n - 1] = {zero, zero, zero};
+    };
+    for (int i = 0; i < n; i++) {
+        s.theta[i] = P::load(b.theta + at(i));
+    }
+
+    // Quasi-static twist, see ElasticRod::updateTwist. Lanes stop updating once
+    // converged, as the per-rod solve breaks out of its loop.
+    P active = one;
+    for (int it = 0; n >= 3 && it < p.twistIterations; it++) {
+        materialFrames();
+        for (int j = 1; j < n - 1; j++) {
+            P grad = zero;
+            P diag = zero;
+            for (int k = j; k <= j + 1; k++) {
+                const P w0 = dot(s.kb[k], s.m2[j]);
+                const P w1 = -dot(s.kb[k], s.m1[j]);
+                const P dw0 = w0 - P::load((k == j ? b.o1x : b.o0x) + at(k));
+                const P dw1 = w1 - P::load((k == j ? b.o1y : b.o0y) + at(k));
+                const P invLen = one / s.rl[ce(k)];
+                // J w = (-w1, w0)
+                grad = grad - stiffness * (w0 * dw1 - w1 * dw0) * invLen;
+                diag = diag + max(stiffness * (w1 * w1 + w0 * w0) - stiffness * (dw0 * w0 + dw1 * w1), zero) * invLen;
+            }
+            const P c0 = twoBeta / (s.rl[ce(j - 1)] + s.rl[ce(j)]);
+            grad = grad + c0 * (s.theta[j] - s.theta[j - 1]);
+            diag = diag + c0;
+            s.twistOff[j] = zero;
+            if (j + 1 < n - 1) {
+                const P c1 = twoBeta / (s.rl[ce(j)] + s.rl[ce(j + 1)]);
+                grad = grad - c1 * (s.theta[j + 1] - s.theta[j]);
+                diag = diag + c1;
+                s.twistOff[j] = -c1;
+            }
+            s.twistDiag[j] = diag;
+            s.twistRhs[j] = grad;
+        }
+        for (int j = 2; j < n - 1; j++) {
+            const P m = s.twistOff[j - 1] / s.twistDiag[j - 1];
+            s.twistDiag[j] = s.twistDiag[j] - m * s.twistOff[j - 1];
+            s.twistRhs[j] = s.twistRhs[j] - m * s.twistRhs[j - 1];
+        }
+        P maxStep = zero;
+        for (int j = n - 2; j >= 1; j--) {
+            if (j + 1 < n - 1) {
+                s.twistRhs[j] = s.twistRhs[j] - s.twistOff[j] * s.twistRhs[j + 1];
+            }
+            s.twistRhs[j] = s.twistRhs[j] / s.twistDiag[j];
+            s.theta[j] = s.theta[j] - s.twistRhs[j] * active;
+            maxStep = max(maxStep, abs(s.twistRhs[j]));
+        }
+        active = select(maxStep < P::set(1e-6f), zero, active);
+    }
+    materialFrames();
+    for (int i = 0; i < n; i++) {
+        s.theta[i].store(b.theta + at(i));
+    }
+
+    // Gradient holonomy terms (i-1, i, i+1) of every vertex
+    for (int i = 0; i < n; i++) {
+        const V3<P> prev = s.kb[i] / (two * s.rl[ce(i - 1)]);
+        const V3<P> next = s.kb[i] / (two * s.rl[ce(i)]);
+        s.t0[i] = prev;
+        s.t1[i] = -prev - next;
+        s.t2[i] = -next;
+    }
+
+    // Block (ia, ib) of the implicit system Hessian, added to the lower band and
+    // its product with the velocities to hv, see ElasticRod::addHessianBlock
+    auto addHessianBlock = [&](int ia, int ib, const P (&block)[3][3])
+    {
+        if (ia < 1 || ib < 1 || ia >= n || ib >= n) {
+            return;
+        }
+        for (int r = 0; r < 3; r++) {
+            P& hv = component(s.hv[ia], r);
+            hv = hv + block[r][0] * s.vel[ib].x + block[r][1] * s.vel[ib].y + block[r][2] * s.vel[ib].z;
+        }
+        for (int r = 0; ib <= ia && r < 3; r++) {
+            for (int c = 0; c < 3 && (ib < ia || c <= r); c++) {
+                P& a = banded::at<hessianBandwidth>(s.band.data(), 3 * ia + r, 3 * ib + c);
+                a = a + block[r][c];
+            }
+        }
+    };
+    // Rows m^T d kb / dx of the previous and next stencil vertex, see ElasticRod::kappaBGrad
+    auto kbGradRows = [&](int k, const V3<P>& m, V3<P>& prev, V3<P>& next)
+    {
+        const P km = dot(s.kb[k], m);
+        prev = (cross(m, s.e[ce(k)]) * two + s.g0[k] * km) / s.denom[k];
+        next = (cross(m, s.e[ce(k - 1)]) * two - s.g1[k] * km) / s.denom[k];
+    };
+
+    // Banded bending force assembly, see ElasticRod::compForces. The implicit
+    // step also assembles the Gauss-Newton bending Hessian.
+    for (int i = 0; i < n; i++) {
+        s.f[i] = {zero, zero, zero};
+        s.h[i] = zero;
+    }
+    if (p.implicit) {
+        std::fill(s.band.begin(), s.band.end(), zero);
+        for (int i = 0; i < n; i++) {
+            s.vel[i] = loadV3<P>(b.vx, b.vy, b.vz, at(i));
+            s.hv[i] = {zero, zero, zero};
+        }
+    }
+    for (int k = 1; k < n; k++) {
+        const P invLen = one / s.rl[ce(k)];
+        const V3<P>& kb = s.kb[k];
+        for (int j = k - 1; j <= k; j++) {
+            const V3<P>& m1 = s.m1[j];
+            const V3<P>& m2 = s.m2[j];
+            const P w0 = dot(kb, m2);
+            const P w1 = -dot(kb, m1);
+            const P rest0 = P::load((j == k - 1 ? b.o0x : b.o1x) + at(k));
+            const P rest1 = P::load((j == k - 1 ? b.o0y : b.o1y) + at(k));
+            const P dw0 = stiffness * (w0 - rest0) * invLen;
+            const P dw1 = stiffness * (w1 - rest1) * invLen;
+
+            // (d omega / d x)^T dw for the three stencil vertices
+            V3<P> gPrev, gNext;
+            kbGradRows(k, m2 * dw0 - m1 * dw1, gPrev, gNext);
+            if (k - 1 >= 1) {
+                s.f[k - 1] = s.f[k - 1] - gPrev;
+            }
+            s.f[k] = s.f[k] + gPrev + gNext;
+            if (k + 1 < n) {
+                s.f[k + 1] = s.f[k + 1] - gNext;
+            }
+            s.h[j] = s.h[j] + (w0 * dw1 - w1 * dw0);
+
+            if (!p.implicit) {
+                continue;
+            }
+            // Gauss-Newton term dw/dx^T B dw/dx with B = stiffness I, from the rows
+            // of d omega / dx for the three stencil vertices
+            std::array<std::array<V3<P>, 3>, 2> rows;
+            kbGradRows(k, m2, rows[0][0], rows[0][2]);
+            kbGradRows(k, -m1, rows[1][0], rows[1][2]);
+            for (auto& row : rows) {
+                row[1] = -(row[0] + row[2]);
+            }
+            const P scale = stiffness * invLen;
+            for (int va = 0; va < 3; va++) {
+                for (int vb = 0; vb < 3; vb++) {
+                    P block[3][3];
+                    for (int r = 0; r < 3; r++) {
+                        for (int c = 0; c < 3; c++) {
+                            block[r][c] = scale * (component(rows[0][va], r) * component(rows[0][vb], c) +
+                                                   component(rows[1][va], r) * component(rows[1][vb], c));
+                        }
+                    }
+                    addHessianBlock(k - 1 + va, k - 1 + vb, block);
+                }
+            }
+        }
+    }
+    for (int i = n - 2; i >= 0; i--) {
+        s.h[i] = s.h[i] + s.h[i + 1];
+    }
+    for (int i = 1; i < n; i++) {
+        if (i > 1) {
+            s.f[i] = s.f[i] + s.t2[i - 1] * s.h[i - 1];
+        }
+        s.f[i] = s.f[i] + s.t1[i] * s.h[i];
+        if (i + 1 < n) {
+            s.f[i] = s.f[i] + s.t0[i + 1] * s.h[i + 1];
+        }
+    }
+
+    const V3<P> gravity = {P::set(p.gravity[0]), P::set(p.gravity[1]), P::set(p.gravity[2])};
+    s.xu[0] = loadV3<P>(b.rx, b.ry, b.rz, at(0));
+    if (p.implicit) {
+        // Linearized backward Euler, see ElasticRod::integrateImplicitEuler
+        const P stretch = P::set(p.stretchStiffness);
+        for (int e = 0; e < n - 1; e++) {
+            const V3<P> t = s.e[e] / s.len[e];
+            P block[3][3], negated[3][3];
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    block[r][c] = stretch * component(t, r) * component(t, c);
+                    negated[r][c] = -block[r][c];
+                }
+            }
+            addHessianBlock(e, e, block);
+            addHessianBlock(e + 1, e + 1, block);
+            addHessianBlock(e, e + 1, negated);
+            addHessianBlock(e + 1, e, negated);
+        }
+        const P dt2 = dt * dt;
+        for (P& a : s.band) {
+            a = a * dt2;
+        }
+        for (int r = 0; r < 3 * n; r++) {
+            P& a = banded::at<hessianBandwidth>(s.band.data(), r, r);
+            a = a + one;
+        }
+        for (int i = 0; i < n; i++) {
+            const V3<P> rhs = i == 0 ? V3<P>{zero, zero, zero} : (s.f[i] + gravity - s.hv[i] * dt) * dt;
+            for (int c = 0; c < 3; c++) {
+                s.rhs[3 * i + c] = component(rhs, c);
+            }
+        }
+
+        // banded::cholesky, lanes that are not positive definite keep the explicit
+        // velocity change like a failed per-rod factorization
+        P factored = one;
+        for (int i = 0; i < 3 * n; i++) {
+            const int first = std::max(0, i - hessianBandwidth);
+            for (int j = first; j <= i; j++) {
+                P sum = banded::at<hessianBandwidth>(s.band.data(), i, j);
+                for (int k = first; k < j; k++) {
+                    sum = sum - banded::at<hessianBandwidth>(s.band.data(), i, k) * banded::at<hessianBandwidth>(s.band.data(), j, k);
+                }
+                if (j < i) {
+                    banded::at<hessianBandwidth>(s.band.data(), i, j) = sum / banded::at<hessianBandwidth>(s.band.data(), j, j);
+                } else {
+                    const typename P::Mask positive = sum > zero;
+                    factored = select(positive, factored, zero);
+                    banded::at<hessianBandwidth>(s.band.data(), i, i) = sqrt(select(positive, sum, one));
+                }
+            }
+        }
+        std::copy(s.rhs.begin(), s.rhs.end(), s.dv.begin());
+        banded::solve<hessianBandwidth>(s.band.data(), 3 * n, s.dv.data());
+
+        // Quadratic drag taken implicitly, see ElasticRod::integrateImplicitEuler
+        const P dragDt = P::set(p.drag) * dt;
+        const typename P::Mask solved = factored > zero;
+        for (int i = 1; i < n; i++) {
+            V3<P> vu;
+            for (int c = 0; c < 3; c++) {
+                component(vu, c) = select(solved, s.dv[3 * i + c], s.rhs[3 * i + c]);
+            }
+            const P ks = dragDt * sqrt(dot(vu, vu));
+            const P scale = (sqrt(one + two * ks) - one) / ks;
+            vu = vu * select(ks > P::set(1e-6f), scale, one);
+            s.xu[i] = loadV3<P>(b.px, b.py, b.pz, at(i)) + (vu + s.vel[i]) * dt;
+        }
+    } else {
+        // Forward Euler with quadratic drag
+        const P halfDrag = P::set(0.5f * p.drag);
+        for (int i = 1; i < n; i++) {
+            V3<P> vu = (s.f[i] + gravity) * dt;
+            vu = vu - normalized(vu) * (halfDrag * dot(vu, vu) * dt);
+            const V3<P> x = loadV3<P>(b.px, b.py, b.pz, at(i));
+            const V3<P> v = loadV3<P>(b.vx, b.vy, b.vz, at(i));
+            s.xu[i] = x + (vu + v) * dt;
+        }
+    }
+
+    // Sphere collisions, projected onto the surface
+    for (size_t c = 0; c < p.numSpheres; c++) {
+        const float* sphere = p.spheres + 4 * c;
+        const V3<P> center = {P::set(sphere[0]), P::set(sphere[1]), P::set(sphere[2])};
+        const P radius = P::set(sphere[3]);
+        for (int i = 1; i < n; i++) {
+            const V3<P> d = center - s.xu[i];
+            const P dist = sqrt(dot(d, d));
+            s.xu[i] = select(dist < radius, center - (d / dist) * radius, s.xu[i]);
+        }
+    }
+
+    // Inextensibility
+    for (int i = 1; i < n; i++) {
+        const V3<P> d = s.xu[i] - s.xu[i - 1];
+        const V3<P> x = s.xu[i - 1] + normalized(d) * s.rl[i - 1];
+        storeV3(b.px, b.py, b.pz, at(i), x);
+        s.corr[i] = x - s.xu[i];
+    }
+    const P inext = P::set(p.inextensibility);
+    const V3<P> rest = {zero, zero, zero};
+    storeV3(b.vx, b.vy, b.vz, at(0), rest);
+    for (int i = 1; i < n - 1; i++) {
+        storeV3(b.vx, b.vy, b.vz, at(i), s.corr[i + 1] * inext / dt);
+    }
+    storeV3(b.vx, b.vy, b.vz, at(n - 1), rest);
+}
+
+} // namespace detail
+} // namespace rodkernels
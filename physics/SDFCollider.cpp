@@ -0,0 +1,436 @@
+#include <SDFCollider.hpp>
+#include <Mesh.hpp>
+#include <Logging.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <tuple>
+
+using Eigen::Vector3f;
+using Eigen::Vector3i;
+
+namespace
+{
+    // "SDF2", bumped whenever the baked field or the file layout changes
+    constexpr uint32_t cacheMagic = 0x32464453;
+    // Samples per side of the bricks that are baked in parallel
+    constexpr int brickSize = 8;
+
+    uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // Closest point q to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5).
+    // Returns the feature q lies on: 0-2 vertex a, b, c, 3-5 edge ab, bc, ca, 6 the face.
+    int closestOnTriangle(const Vector3f& p, const Vector3f& a, const Vector3f& b, const Vector3f& c, Vector3f& q)
+    {
+        const Vector3f ab = b - a;
+        const Vector3f ac = c - a;
+        const Vector3f ap = p - a;
+        const float d1 = ab.dot(ap);
+        const float d2 = ac.dot(ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) {
+            q = a;
+            return 0;
+        }
+        const Vector3f bp = p - b;
+        const float d3 = ab.dot(bp);
+        const float d4 = ac.dot(bp);
+        if (d3 >= 0.0f && d4 <= d3) {
+            q = b;
+            return 1;
+        }
+        const float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            q = a + d1 / (d1 - d3) * ab;
+            return 3;
+        }
+        const Vector3f cp = p - c;
+        const float d5 = ab.dot(cp);
+        const float d6 = ac.dot(cp);
+        if (d6 >= 0.0f && d5 <= d6) {
+            q = c;
+            return 2;
+        }
+        const float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            q = a + d2 / (d2 - d6) * ac;
+            return 5;
+        }
+        const float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+            q = b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+            return 4;
+        }
+        const float denom = 1.0f / (va + vb + vc);
+        q = a + ab * (vb * denom) + ac * (vc * denom);
+        return 6;
+    }
+}
+
+SDFCollider::SDFCollider(Eigen::Vector3f center, const SurfaceMesh& mesh, const std::string& cachePath,
+                         float scale, int resolution, int bandCells)
+    : Collider(center)
+{
+    // SurfaceMesh splits vertices by normal and texture coordinate, the sign of the
+    // field needs the triangles around each vertex and edge, so weld them back
+    std::vector<Vector3f> vertices;
+    std::vector<uint32_t> indices;
+    std::map<std::tuple<float, float, float>, uint32_t> welded;
+    std::vector<uint32_t> remap(mesh.getVertices().size());
+    for (size_t i = 0; i < remap.size(); i++) {
+        const glm::vec3 v = mesh.getVertices()[i] * scale;
+        const auto [it, inserted] = welded.emplace(std::make_tuple(v.x, v.y, v.z), (uint32_t)vertices.size());
+        if (inserted) {
+            vertices.emplace_back(v.x, v.y, v.z);
+        }
+        remap[i] = it->second;
+    }
+    for (GLuint index : mesh.getIndices()) {
+        indices.push_back(remap[index]);
+    }
+
+    uint64_t key = fnv1a(vertices.data(), vertices.size() * sizeof(Vector3f));
+    key = fnv1a(indices.data(), indices.size() * sizeof(uint32_t), key);
+    const std::array<int, 2> settings = {resolution, bandCells};
+    key = fnv1a(settings.data(), sizeof(settings), key);
+    if (LoadCache(cachePath, key)) {
+        spdlog::info("Loaded {}x{}x{} SDF from '{}'", dims.x(), dims.y(), dims.z(), cachePath);
+        return;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    Bake(vertices, indices, resolution, bandCells);
+    auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("Baked {}x{}x{} SDF of {} triangles in {:.2f}s", dims.x(), dims.y(), dims.z(),
+                 indices.size() / 3, std::chrono::duration<float>(end - start).count());
+    SaveCache(cachePath, key);
+}
+
+void SDFCollider::Bake(const std::vector<Vector3f>& vertices, const std::vector<uint32_t>& indices,
+                       int resolution, int bandCells)
+{
+    const size_t numTris = indices.size() / 3;
+    Vector3f lower = Vector3f::Constant(std::numeric_limits<float>::max());
+    Vector3f upper = Vector3f::Constant(std::numeric_limits<float>::lowest());
+    for (const Vector3f& v : vertices) {
+        lower = lower.cwiseMin(v);
+        upper = upper.cwiseMax(v);
+    }
+    if (vertices.empty()) {
+        lower = upper = Vector3f::Zero();
+    }
+    cellSize = std::max((upper - lower).maxCoeff() / std::max(resolution, 1), 1e-6f);
+    band = bandCells * cellSize;
+    // Pad past the band so the grid border is always outside it
+    const int pad = bandCells + 1;
+    origin = lower - Vector3f::Constant(pad * cellSize);
+    dims = ((upper - lower) / cellSize).array().ceil().cast<int>() + 2 * pad + 1;
+    distances.assign((size_t)dims.prod(), std::numeric_limits<float>::infinity());
+
+    // Angle-weighted pseudo-normals of the faces, edges and vertices (Baerentzen and
+    // Aanaes 2005). The sign of (p - q) . n for the pseudo-normal n of the feature
+    // holding the closest point q is correct even where that is an edge or vertex.
+    std::vector<Vector3f> faceNormals(numTris, Vector3f::Zero());
+    std::vector<Vector3f> vertexNormals(vertices.size(), Vector3f::Zero());
+    std::vector<Vector3f> edgeNormals;
+    std::vector<std::array<int, 3>> triEdges(numTris);
+    std::map<std::pair<uint32_t, uint32_t>, int> edgeIds;
+    std::vector<Vector3f> triLower(numTris), triUpper(numTris);
+    for (size_t t = 0; t < numTris; t++) {
+        const uint32_t* tri = &indices[3 * t];
+        Vector3f n = (vertices[tri[1]] - vertices[tri[0]]).cross(vertices[tri[2]] - vertices[tri[0]]);
+        if (n.squaredNorm() == 0.0f) {
+            continue;
+        }
+        n.normalize();
+        faceNormals[t] = n;
+        for (int k = 0; k < 3; k++) {
+            const Vector3f e1 = (vertices[tri[(k + 1) % 3]] - vertices[tri[k]]).normalized();
+            const Vector3f e2 = (vertices[tri[(k + 2) % 3]] - vertices[tri[k]]).normalized();
+            vertexNormals[tri[k]] += std::acos(std::clamp(e1.dot(e2), -1.0f, 1.0f)) * n;
+            const auto edge = std::minmax(tri[k], tri[(k + 1) % 3]);
+            const auto [it, inserted] = edgeIds.emplace(edge, (int)edgeNormals.size());
+            if (inserted) {
+                edgeNormals.push_back(Vector3f::Zero());
+            }
+            edgeNormals[it->second] += n;
+            triEdges[t][k] = it->second;
+        }
+        triLower[t] = vertices[tri[0]].cwiseMin(vertices[tri[1]]).cwiseMin(vertices[tri[2]]) - Vector3f::Constant(band);
+        triUpper[t] = vertices[tri[0]].cwiseMax(vertices[tri[1]]).cwiseMax(vertices[tri[2]]) + Vector3f::Constant(band);
+    }
+
+    // Every brick lists the triangles whose band overlaps it, in triangle order so
+    // ties between equally close triangles resolve the same way on every run
+    const Vector3i bricks = (dims.array() + brickSize - 1) / brickSize;
+    std::vector<std::vector<int>> brickTris((size_t)bricks.prod());
+    for (size_t t = 0; t < numTris; t++) {
+        if (faceNormals[t].isZero()) {
+            continue;
+        }
+        const Vector3i lo = ((triLower[t] - origin) / cellSize).array().ceil().cast<int>().max(0) / brickSize;
+        const Vector3i hi = ((triUpper[t] - origin) / cellSize).array().floor().cast<int>().min(dims.array() - 1) / brickSize;
+        for (int k = lo.z(); k <= hi.z(); k++)
+            for (int j = lo.y(); j <= hi.y(); j++)
+                for (int i = lo.x(); i <= hi.x(); i++)
+                    brickTris[i + (size_t)bricks.x() * (j + (size_t)bricks.y() * k)].push_back((int)t);
+    }
+
+    std::vector<int> brickIndices(brickTris.size());
+    std::iota(brickIndices.begin(), brickIndices.end(), 0);
+    std::for_each(std::execution::par_unseq, brickIndices.begin(), brickIndices.end(), [&](int b) {
+        const std::vector<int>& tris = brickTris[b];
+        if (tris.empty()) {
+            return;
+        }
+        const Vector3i first = Vector3i(b % bricks.x(), (b / bricks.x()) % bricks.y(), b / (bricks.x() * bricks.y())) * brickSize;
+        const Vector3i last = (first.array() + brickSize).min(dims.array());
+        for (int k = first.z(); k < last.z(); k++)
+            for (int j = first.y(); j < last.y(); j++)
+                for (int i = first.x(); i < last.x(); i++)
+                {
+                    const Vector3f p = origin + cellSize * Vector3f((float)i, (float)j, (float)k);
+                    float bestDist2 = band * band;
+                    float sign = 0.0f;
+                    for (int t : tris)
+                    {
+                        if ((p.array() < triLower[t].array()).any() || (p.array() > triUpper[t].array()).any())
+                            continue;
+                        const uint32_t* tri = &indices[3 * t];
+                        Vector3f q;
+                        const int feature = closestOnTriangle(p, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], q);
+                        const float dist2 = (p - q).squaredNorm();
+                        if (dist2 >= bestDist2)
+                            continue;
+                        bestDist2 = dist2;
+                        const Vector3f& pseudoNormal = feature < 3 ? vertexNormals[tri[feature]]
+                                                     : feature < 6 ? edgeNormals[triEdges[t][feature - 3]]
+                                                     : faceNormals[t];
+                        sign = (p - q).dot(pseudoNormal) < 0.0f ? -1.0f : 1.0f;
+                    }
+                    if (sign != 0.0f)
+                        distances[Index(i, j, k)] = sign * std::sqrt(bestDist2);
+                }
+    });
+
+    FloodFarSigns();
+    PropagateInside();
+}
+
+void SDFCollider::FloodFarSigns()
+{
+    // Samples outside the band were left infinite. Those reachable from the border
+    // without crossing the band are outside, the rest are enclosed by the surface.
+    // A mesh with holes wider than the band floods its inside and reads as outside.
+    std::vector<char> outside(distances.size(), 0);
+    std::vector<size_t> queue;
+    auto visit = [&](int i, int j, int k) {
+        const size_t index = Index(i, j, k);
+        if (!outside[index] && std::isinf(distances[index])) {
+            outside[index] = 1;
+            queue.push_back(index);
+        }
+    };
+    for (int k = 0; k < dims.z(); k++)
+        for (int j = 0; j < dims.y(); j++)
+            for (int i = 0; i < dims.x(); i++)
+                if (i == 0 || j == 0 || k == 0 || i == dims.x() - 1 || j == dims.y() - 1 || k == dims.z() - 1)
+                    visit(i, j, k);
+    for (size_t head = 0; head < queue.size(); head++) {
+        const int i = (int)(queue[head] % dims.x());
+        const int j = (int)(queue[head] / dims.x() % dims.y());
+        const int k = (int)(queue[head] / ((size_t)dims.x() * dims.y()));
+        if (i > 0) visit(i - 1, j, k);
+        if (j > 0) visit(i, j - 1, k);
+        if (k > 0) visit(i, j, k - 1);
+        if (i < dims.x() - 1) visit(i + 1, j, k);
+        if (j < dims.y() - 1) visit(i, j + 1, k);
+        if (k < dims.z() - 1) visit(i, j, k + 1);
+    }
+    for (size_t i = 0; i < distances.size(); i++) {
+        if (std::isinf(distances[i])) {
+            distances[i] = outside[i] ? band : -std::numeric_limits<float>::infinity();
+        }
+    }
+}
+
+void SDFCollider::PropagateInside()
+{
+    // Offsets to the 13 neighbours before a sample in scan order, and their distances
+    std::vector<std::pair<Vector3i, float>> before;
+    for (int k = -1; k <= 0; k++)
+        for (int j = -1; j <= 1; j++)
+            for (int i = -1; i <= 1; i++)
+                if (k < 0 || j < 0 || (j == 0 && i < 0))
+                    before.push_back({Vector3i(i, j, k), cellSize * Vector3f((float)i, (float)j, (float)k).norm()});
+
+    // Enclosed samples are more than the band from the grid border, so their
+    // neighbours are all in the grid
+    std::vector<size_t> deep;
+    for (size_t i = 0; i < distances.size(); i++) {
+        if (std::isinf(distances[i])) {
+            deep.push_back(i);
+        }
+    }
+    // Chamfer passes, alternately forwards over the neighbours before each sample and
+    // backwards over those after it, until a pass changes nothing
+    bool changed = !deep.empty();
+    for (int pass = 0; changed; pass++) {
+        changed = false;
+        const int direction = pass % 2 == 0 ? 1 : -1;
+        for (size_t n = 0; n < deep.size(); n++) {
+            const size_t index = deep[direction > 0 ? n : deep.size() - 1 - n];
+            const Vector3i sample((int)(index % dims.x()), (int)(index / dims.x() % dims.y()),
+                                  (int)(index / ((size_t)dims.x() * dims.y())));
+            float distance = distances[index];
+            for (const auto& [offset, step] : before) {
+                const Vector3i q = sample + direction * offset;
+                const float neighbour = distances[Index(q.x(), q.y(), q.z())];
+                if (neighbour < 0.0f) {
+                    distance = std::max(distance, neighbour - step);
+                }
+            }
+            if (distance > distances[index]) {
+                distances[index] = distance;
+                changed = true;
+            }
+        }
+    }
+    // Samples walled in by band samples that all read outside, as a broken mesh can
+    // leave, are clamped to the band
+    for (size_t index : deep) {
+        if (std::isinf(distances[index])) {
+            distances[index] = -band;
+        }
+    }
+}
+
+float SDFCollider::SignedDistance(const Eigen::Vector3f& pos) const
+{
+    Vector3f normal;
+    return SignedDistance(pos, normal);
+}
+
+float SDFCollider::SignedDistance(const Eigen::Vector3f& pos, Eigen::Vector3f& normal) const
+{
+    const float distance = LocalDistance(ToLocal(pos), normal);
+    if (!normal.isZero()) {
+        normal = NormalToWorld(normal);
+    }
+    return distance * MinScale();
+}
+
+float SDFCollider::LocalDistance(const Eigen::Vector3f& local, Eigen::Vector3f& normal) const
+{
+    const Vector3f g = (local - origin) / cellSize;
+    const Vector3f cellf = g.array().floor();
+    if ((cellf.array() < 0.0f).any() || (cellf.array() >= (dims.array() - 1).cast<float>()).any()) {
+        normal.setZero();
+        return band;
+    }
+    const Vector3i cell = cellf.cast<int>();
+    const Vector3f f = g - cellf;
+    const size_t sy = dims.x();
+    const size_t sz = (size_t)dims.x() * dims.y();
+    const float* c = &distances[Index(cell.x(), cell.y(), cell.z())];
+    const float c000 = c[0], c100 = c[1], c010 = c[sy], c110 = c[sy + 1];
+    const float c001 = c[sz], c101 = c[sz + 1], c011 = c[sz + sy], c111 = c[sz + sy + 1];
+
+    // Interpolate along x, then y, then z, differentiating each stage for the gradient
+    const float c00 = c000 + f.x() * (c100 - c000);
+    const float c10 = c010 + f.x() * (c110 - c010);
+    const float c01 = c001 + f.x() * (c101 - c001);
+    const float c11 = c011 + f.x() * (c111 - c011);
+    const float c0 = c00 + f.y() * (c10 - c00);
+    const float c1 = c01 + f.y() * (c11 - c01);
+
+    const float dx00 = c100 - c000 + f.y() * ((c110 - c010) - (c100 - c000));
+    const float dx01 = c101 - c001 + f.y() * ((c111 - c011) - (c101 - c001));
+    normal = Vector3f(dx00 + f.z() * (dx01 - dx00),
+                      (c10 - c00) + f.z() * ((c11 - c01) - (c10 - c00)),
+                      c1 - c0);
+    const float length = normal.norm();
+    if (length > 0.0f) {
+        normal /= length;
+    }
+    return c0 + f.z() * (c1 - c0);
+}
+
+Eigen::Vector3f SDFCollider::ClosestSurfacePoint(const Eigen::Vector3f& pos) const
+{
+    Vector3f normal;
+    const Vector3f local = ToLocal(pos);
+    const float distance = LocalDistance(local, normal);
+    if (distance >= band) {
+        return pos;
+    }
+    return ToWorld(local - distance * normal);
+}
+
+bool SDFCollider::IsCollidingWith(Collider& other, CollisionInfo& collision)
+{
+    Vector3f normal;
+    const float distance = SignedDistance(other.center, normal);
+    const Vector3f diff = center - (other.center - distance * normal);
+    const float dist = diff.norm();
+    collision.normal = dist > 0.0f ? Vector3f(diff / dist) : -normal;
+    collision.penetration = distance;
+    return distance < 0.0f;
+}
+
+float SDFCollider::GetBoundaryAt(Eigen::Vector3f pos)
+{
+    return (center - ClosestSurfacePoint(pos)).norm();
+}
+
+bool SDFCollider::LoadCache(const std::string& path, uint64_t key)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    uint32_t magic = 0;
+    uint64_t storedKey = 0;
+    in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    in.read(reinterpret_cast<char*>(&storedKey), sizeof(storedKey));
+    if (!in || magic != cacheMagic || storedKey != key) {
+        return false;
+    }
+    in.read(reinterpret_cast<char*>(dims.data()), 3 * sizeof(int));
+    in.read(reinterpret_cast<char*>(origin.data()), 3 * sizeof(float));
+    in.read(reinterpret_cast<char*>(&cellSize), sizeof(cellSize));
+    in.read(reinterpret_cast<char*>(&band), sizeof(band));
+    if (!in || (dims.array() < 2).any()) {
+        return false;
+    }
+    distances.resize((size_t)dims.prod());
+    in.read(reinterpret_cast<char*>(distances.data()), distances.size() * sizeof(float));
+    return (bool)in;
+}
+
+void SDFCollider::SaveCache(const std::string& path, uint64_t key) const
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&cacheMagic), sizeof(cacheMagic));
+    out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    out.write(reinterpret_cast<const char*>(dims.data()), 3 * sizeof(int));
+    out.write(reinterpret_cast<const char*>(origin.data()), 3 * sizeof(float));
+    out.write(reinterpret_cast<const char*>(&cellSize), sizeof(cellSize));
+    out.write(reinterpret_cast<const char*>(&band), sizeof(band));
+    out.write(reinterpret_cast<const char*>(distances.data()), distances.size() * sizeof(float));
+    if (!out) {
+        spdlog::warn("Could not write SDF cache '{}'", path);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Collider.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SurfaceMesh;
+
+// Collider for an arbitrary triangle mesh, stored as a signed distance field on a
+// regular grid around it. Distances are exact within a narrow band of the surface,
+// clamped to band outside it and carried on by a chamfer pass inside, so a query is
+// one trilinear lookup whatever the triangle count. The field is in the mesh's own
+// space and world queries go through the collider's transform, so moving, turning or
+// scaling the mesh never rebakes it.
+class SDFCollider : public Collider
+{
+public:
+    // Bakes the field of mesh scaled by scale, with resolution cells along the longest
+    // side of its bounds and an exact band bandCells cells wide on either side of the
+    // surface. A field cached at cachePath with the same mesh and settings is loaded
+    // instead, otherwise the new one is written there.
+    SDFCollider(Eigen::Vector3f center, const SurfaceMesh& mesh, const std::string& cachePath,
+                float scale = 1.0f, int resolution = 96, int bandCells = 3);
+
+    /*
+    * Returns true if the center of other is inside the mesh. The normal points from
+    * the closest surface point towards center, like SphereCollider's.
+    */
+    bool IsCollidingWith(Collider& other, CollisionInfo& collision) override;
+    /*
+    * Returns the distance from center to the surface point closest to pos, so that
+    * center - normal * GetBoundaryAt(pos) is that surface point
+    */
+    float GetBoundaryAt(Eigen::Vector3f pos) override;
+
+    // Trilinearly interpolated signed distance at pos, negative inside the mesh. Under
+    // non-uniform scale it is the field's distance times the smallest scale, which
+    // never overestimates how far the surface is.
+    float SignedDistance(const Eigen::Vector3f& pos) const;
+    // SignedDistance() and its normalized gradient, the outward normal of the closest
+    // surface. The normal is zero outside the grid.
+    float SignedDistance(const Eigen::Vector3f& pos, Eigen::Vector3f& normal) const;
+    // SignedDistance() at local, a position in the collider's own space, with the
+    // distance and normal also in that space
+    float LocalDistance(const Eigen::Vector3f& local, Eigen::Vector3f& normal) const;
+    // Closest surface point to pos, pos itself if it is outside and further than the band
+    Eigen::Vector3f ClosestSurfacePoint(const Eigen::Vector3f& pos) const;
+
+    // Grid samples per axis, the first sample is at origin in the collider's own space
+    Eigen::Vector3i dims = Eigen::Vector3i::Zero();
+    Eigen::Vector3f origin = Eigen::Vector3f::Zero();
+    float cellSize = 1.0f;
+    // Distances are exact below this, and clamped to it outside beyond it
+    float band = 0.0f;
+
+private:
+    // Computes the field from welded triangles, in parallel over bricks of samples
+    void Bake(const std::vector<Eigen::Vector3f>& vertices, const std::vector<uint32_t>& indices,
+              int resolution, int bandCells);
+    // Sets every sample outside the band that is reachable from the grid border to
+    // band, and marks those the surface encloses with -infinity
+    void FloodFarSigns();
+    // Gives the enclosed samples their chamfer distance to the band through the inside,
+    // so the gradient still points out of the mesh however deep a point is
+    void PropagateInside();
+    bool LoadCache(const std::string& path, uint64_t key);
+    void SaveCache(const std::string& path, uint64_t key) const;
+    size_t Index(int i, int j, int k) const { return i + (size_t)dims.x() * (j + (size_t)dims.y() * k); }
+
+    std::vector<float> distances;
+};
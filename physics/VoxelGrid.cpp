@@ -1,59 +1,344 @@
 #include <VoxelGrid.hpp>
+#include <algorithm>
+#include <execution>
+#include <numeric>
 
-VoxelGrid::VoxelGrid()
+// Bits per axis of a voxel key, coordinates are offset so negative ones pack too
+static constexpr int keyAxisBits = 21;
+static constexpr int keyAxisOffset = 1 << (keyAxisBits - 1);
+// Positions sampleVelocities() resolves before interpolating them
+static constexpr size_t gatherBlock = 16;
+
+VoxelTable::VoxelTable(size_t capacity, int corners) : corners(corners)
+{
+    // Power of two slots, at least twice the entries
+    size_t numSlots = 16;
+    while (numSlots < 2 * capacity)
+        numSlots *= 2;
+    slots.assign(numSlots, 0);
+    entrySlots.reserve(capacity);
+    keys.reserve(capacity);
+    voxelMasses.reserve(capacity * corners);
+    voxelVelocities.reserve(capacity * corners);
+}
+
+int VoxelTable::insert(uint64_t key)
+{
+    if (2 * (keys.size() + 1) > slots.size())
+        rehash(2 * slots.size());
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask)
+    {
+        const int entry = slots[slot] - 1;
+        if (entry < 0)
+        {
+            slots[slot] = (int)keys.size() + 1;
+            entrySlots.push_back((int)slot);
+            keys.push_back(key);
+            voxelMasses.resize(voxelMasses.size() + corners, 0.0f);
+            voxelVelocities.resize(voxelVelocities.size() + corners, Eigen::Vector3f::Zero());
+            return (int)keys.size() - 1;
+        }
+        if (keys[entry] == key)
+            return entry;
+    }
+}
+
+int VoxelTable::find(uint64_t key) const
+{
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask)
+    {
+        const int entry = slots[slot] - 1;
+        if (entry < 0 || keys[entry] == key)
+            return entry;
+    }
+}
+
+void VoxelTable::clear()
+{
+    for (int slot : entrySlots)
+        slots[slot] = 0;
+    entrySlots.clear();
+    keys.clear();
+    voxelMasses.clear();
+    voxelVelocities.clear();
+}
+
+void VoxelTable::rehash(size_t capacity)
+{
+    slots.assign(capacity, 0);
+    const size_t mask = capacity - 1;
+    for (size_t entry = 0; entry < keys.size(); entry++)
+    {
+        size_t slot = hash(keys[entry]) & mask;
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = (int)entry + 1;
+        entrySlots[entry] = (int)slot;
+    }
+}
+
+VoxelGrid::VoxelGrid(size_t reservedVoxels)
 {
-    voxelMutex = std::make_shared<std::mutex>();
+    // Neighbouring rods share voxels, so a chunk table rarely holds more than its share
+    for (VoxelTable& table : chunkTables)
+        table = VoxelTable(reservedVoxels / splatChunks, 8);
+    for (VoxelTable& shard : shards)
+        shard = VoxelTable(reservedVoxels / splatChunks);
+    for (VoxelTable& cells : cellShards)
+        cells = VoxelTable(reservedVoxels / splatChunks, 8);
+    contributions.resize(splatChunks * splatChunks);
+    cellKeys.resize(splatChunks * splatChunks);
+    for (auto& bucket : contributions)
+        bucket.reserve(reservedVoxels / (splatChunks * splatChunks));
+    for (auto& bucket : cellKeys)
+        bucket.reserve(reservedVoxels / (splatChunks * splatChunks));
 }
 
 void VoxelGrid::initVoxelGrid()
 {
-    int numSteps = (int)(voxelGridExtent/voxelSize);
-    size_t hash;
-    bool isFirstRun = voxelMasses.empty();
-    for(int i = 0; i < numSteps; i++)    
-        for(int j = 0; j < numSteps; j++)        
-            for(int k = 0; k < numSteps; k++)
-            {
-                if(isFirstRun)
-                {                    
-                    voxelMasses.emplace_back(0);
-                    voxelVelocities.emplace_back(Eigen::Vector3f::Zero());
-                }
-                else
-                {
-                    voxelMasses[i + j*numSteps + k*numSteps*numSteps] = 0;
-                    voxelVelocities[i + j*numSteps + k*numSteps*numSteps] = Eigen::Vector3f::Zero();
-                }               
-                    
-            } 
-}
-
-void VoxelGrid::getVoxelCoordinates(const Eigen::Vector3f &position, Eigen::Vector3f &firstVoxelCoord, Eigen::Vector3f &localPosition)
-{
-    // Use side length of cube that contains the voxel grid to determine the origin
-    Eigen::Vector3f origin = {-voxelGridExtent*0.5f, -voxelGridExtent*0.5f, -voxelGridExtent*0.5f};
-    Eigen::Vector3f coordsInVoxel = (position-origin)/voxelSize;
+    for (VoxelTable& table : chunkTables)
+        table.clear();
+    for (VoxelTable& shard : shards)
+        shard.clear();
+    for (VoxelTable& cells : cellShards)
+        cells.clear();
+    for (auto& bucket : contributions)
+        bucket.clear();
+    for (auto& bucket : cellKeys)
+        bucket.clear();
+}
+
+void VoxelGrid::getVoxelCoordinates(const Eigen::Vector3f &position, Eigen::Vector3i &firstVoxelCoord, Eigen::Vector3f &localPosition) const
+{
+    Eigen::Vector3f coordsInVoxel = position/voxelSize;
     // Get indices of voxel containing sampling point
     Eigen::Vector3f indices = Eigen::Vector3f(coordsInVoxel.array().floor());
-    firstVoxelCoord = indices;
+    firstVoxelCoord = indices.cast<int>();
     localPosition = coordsInVoxel - indices;
 }
 
-void VoxelGrid::sampleVoxelVelocity(Eigen::Vector3f &vertexVel, const Eigen::Vector3f &index)
+void VoxelGrid::sampleVoxelVelocity(Eigen::Vector3f &vertexVel, const Eigen::Vector3i &index) const
+{
+    float mass;
+    sampleVoxel(index, mass, vertexVel);
+}
+
+void VoxelGrid::sampleVoxel(const Eigen::Vector3i &index, float &mass, Eigen::Vector3f &velocity) const
 {
-    size_t hash = getSpatialHash(index);
-    float norm = voxelMasses[hash] == 0 ? 1 : voxelMasses[hash];
-    vertexVel = voxelVelocities[hash]/norm;
+    const uint64_t key = getVoxelKey(index);
+    const VoxelTable& shard = shards[shardOf(key)];
+    const int entry = shard.find(key);
+    if (entry < 0)
+    {
+        mass = 0.0f;
+        velocity = Eigen::Vector3f::Zero();
+        return;
+    }
+    mass = shard.voxelMasses[entry];
+    float norm = mass == 0 ? 1 : mass;
+    velocity = shard.voxelVelocities[entry]/norm;
 }
 
-// Based on the paper "Real-time 3D Reconstruction at Scale using Voxel Hashing"
-size_t VoxelGrid::getSpatialHash(Eigen::Vector3f pos)
+// Integer voxel keys as in "Real-time 3D Reconstruction at Scale using Voxel Hashing",
+// packed losslessly so that distinct voxels never collide
+uint64_t VoxelGrid::getVoxelKey(const Eigen::Vector3i &index)
 {
-    int numSteps = (int)(voxelGridExtent/voxelSize);
-    int hash = pos[0] + pos[1]*numSteps + pos[2]*numSteps*numSteps;
-    if(hash >= numSteps*numSteps*numSteps)
-        printf("Hash out of bounds: %d\n", hash);
-    return hash;
-    // size_t n = (size_t)pow((double)(voxelGridExtent/voxelSize),3.0);
-    // return ((int)pos[0]*prime1^(int)pos[1]*prime2^(int)pos[2]*prime3) % n;
-}
\ No newline at end of file
+    const uint64_t mask = (uint64_t(1) << keyAxisBits) - 1;
+    return (uint64_t(index[0] + keyAxisOffset) & mask) |
+           (uint64_t(index[1] + keyAxisOffset) & mask) << keyAxisBits |
+           (uint64_t(index[2] + keyAxisOffset) & mask) << (2 * keyAxisBits);
+}
+
+uint64_t VoxelGrid::cornerStride(int c)
+{
+    return uint64_t(c & 1) | uint64_t((c >> 1) & 1) << keyAxisBits | uint64_t(c >> 2) << (2 * keyAxisBits);
+}
+
+void VoxelGrid::cornerWeights(const Eigen::Vector3f &localPosition, float *weights)
+{
+    const float wx[2] = {1.0f - localPosition[0], localPosition[0]};
+    const float wy[2] = {1.0f - localPosition[1], localPosition[1]};
+    const float wz[2] = {1.0f - localPosition[2], localPosition[2]};
+    for (int c = 0; c < 8; c++)
+        weights[c] = wx[c & 1] * wy[(c >> 1) & 1] * wz[c >> 2];
+}
+
+void VoxelGrid::splat(int chunk, const Eigen::Vector3f &position, const Eigen::Vector3f &velocity)
+{
+    Eigen::Vector3i firstVoxelCoord;
+    Eigen::Vector3f localPosition;
+    getVoxelCoordinates(position, firstVoxelCoord, localPosition);
+    float weights[8];
+    cornerWeights(localPosition, weights);
+
+    // One lookup for the cell, its 8 corners are consecutive
+    VoxelTable& table = chunkTables[chunk];
+    const int entry = table.insert(getVoxelKey(firstVoxelCoord));
+    float* masses = &table.voxelMasses[entry * 8];
+    Eigen::Vector3f* velocities = &table.voxelVelocities[entry * 8];
+    for (int c = 0; c < 8; c++)
+    {
+        masses[c] += weights[c];
+        velocities[c] += weights[c] * velocity;
+    }
+}
+
+void VoxelGrid::reduceSplats()
+{
+    std::vector<int> indices(splatChunks);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    // The first two passes grow buckets and tables, and par_unseq does not allow
+    // allocating, so the passes run par
+
+    // Spread every chunk's cells and corner contributions over the shards they belong to
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int chunk)
+    {
+        const VoxelTable& table = chunkTables[chunk];
+        for (size_t e = 0; e < table.size(); e++)
+        {
+            const uint64_t key = table.keys[e];
+            cellKeys[chunk * splatChunks + shardOf(key)].push_back(key);
+            for (int c = 0; c < 8; c++)
+            {
+                const uint64_t cornerKey = key + cornerStride(c);
+                contributions[chunk * splatChunks + shardOf(cornerKey)].push_back(
+                    {cornerKey, table.voxelMasses[e * 8 + c], table.voxelVelocities[e * 8 + c]});
+            }
+        }
+    });
+
+    // Each shard takes its voxels from every chunk in chunk order, so sums are
+    // deterministic and no two shards write the same table
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int s)
+    {
+        VoxelTable& shard = shards[s];
+        for (int chunk = 0; chunk < splatChunks; chunk++)
+        {
+            for (const Contribution& contribution : contributions[chunk * splatChunks + s])
+            {
+                const int entry = shard.insert(contribution.key);
+                shard.voxelMasses[entry] += contribution.mass;
+                shard.voxelVelocities[entry] += contribution.velocity;
+            }
+        }
+        for (int chunk = 0; chunk < splatChunks; chunk++)
+        {
+            for (uint64_t key : cellKeys[chunk * splatChunks + s])
+                cellShards[s].insert(key);
+        }
+    });
+
+    // Average the corner velocities of every splatted cell once, rather than per sample
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](int s)
+    {
+        VoxelTable& cells = cellShards[s];
+        for (size_t e = 0; e < cells.size(); e++)
+        {
+            for (int c = 0; c < 8; c++)
+            {
+                const uint64_t cornerKey = cells.keys[e] + cornerStride(c);
+                const VoxelTable& shard = shards[shardOf(cornerKey)];
+                const int entry = shard.find(cornerKey);
+                const float mass = shard.voxelMasses[entry];
+                cells.voxelMasses[e * 8 + c] = mass;
+                cells.voxelVelocities[e * 8 + c] = shard.voxelVelocities[entry] / (mass == 0 ? 1 : mass);
+            }
+        }
+    });
+}
+
+Eigen::Vector3f VoxelGrid::sampleVelocity(const Eigen::Vector3f &position) const
+{
+    Eigen::Vector3f velocity;
+    sampleVelocities(&position, 1, &velocity);
+    return velocity;
+}
+
+void VoxelGrid::sampleVelocities(const Eigen::Vector3f *positions, size_t count, Eigen::Vector3f *velocities,
+                                 float *densities, Eigen::Vector3f *densityGradients) const
+{
+    std::array<const Eigen::Vector3f*, gatherBlock> corners;
+    std::array<const float*, gatherBlock> cornerMasses;
+    std::array<Eigen::Vector3f, gatherBlock> localPositions;
+    std::array<float, gatherBlock * 8> weights;
+    // Corners of cells that were not splatted, sampled vertex by vertex
+    std::array<Eigen::Vector3f, gatherBlock * 8> unsplatted;
+    std::array<float, gatherBlock * 8> unsplattedMasses;
+    const bool sampleDensity = densities || densityGradients;
+
+    for (size_t begin = 0; begin < count; begin += gatherBlock)
+    {
+        const size_t n = std::min(gatherBlock, count - begin);
+        for (size_t i = 0; i < n; i++)
+        {
+            Eigen::Vector3i firstVoxelCoord;
+            getVoxelCoordinates(positions[begin + i], firstVoxelCoord, localPositions[i]);
+            cornerWeights(localPositions[i], &weights[i * 8]);
+
+            const uint64_t key = getVoxelKey(firstVoxelCoord);
+            const VoxelTable& cells = cellShards[shardOf(key)];
+            const int entry = cells.find(key);
+            if (entry >= 0)
+            {
+                corners[i] = &cells.voxelVelocities[entry * 8];
+                cornerMasses[i] = &cells.voxelMasses[entry * 8];
+                continue;
+            }
+            for (int c = 0; c < 8; c++)
+                sampleVoxel(firstVoxelCoord + Eigen::Vector3i(c & 1, (c >> 1) & 1, c >> 2), unsplattedMasses[i * 8 + c], unsplatted[i * 8 + c]);
+            corners[i] = &unsplatted[i * 8];
+            cornerMasses[i] = &unsplattedMasses[i * 8];
+        }
+
+        // Trilinear interpolation with fixed corner strides
+        for (size_t i = 0; i < n; i++)
+        {
+            Eigen::Vector3f velocity = Eigen::Vector3f::Zero();
+            for (int c = 0; c < 8; c++)
+                velocity += weights[i * 8 + c] * corners[i][c];
+            velocities[begin + i] = velocity;
+        }
+        if (!sampleDensity)
+            continue;
+
+        // Density and its gradient, the derivative of each corner weight along an
+        // axis swaps that axis' factor for -1 or +1. Corner masses are per voxel, so
+        // both are divided by its volume to not depend on voxelSize.
+        const float invVolume = 1.0f / (voxelSize * voxelSize * voxelSize);
+        for (size_t i = 0; i < n; i++)
+        {
+            const Eigen::Vector3f& l = localPositions[i];
+            const float wx[2] = {1.0f - l[0], l[0]};
+            const float wy[2] = {1.0f - l[1], l[1]};
+            const float wz[2] = {1.0f - l[2], l[2]};
+            float density = 0.0f;
+            Eigen::Vector3f gradient = Eigen::Vector3f::Zero();
+            for (int c = 0; c < 8; c++)
+            {
+                const float m = cornerMasses[i][c];
+                const float sx = (c & 1) ? 1.0f : -1.0f;
+                const float sy = ((c >> 1) & 1) ? 1.0f : -1.0f;
+                const float sz = (c >> 2) ? 1.0f : -1.0f;
+                density += weights[i * 8 + c] * m;
+                gradient += m * Eigen::Vector3f(sx * wy[(c >> 1) & 1] * wz[c >> 2],
+                                                sy * wx[c & 1] * wz[c >> 2],
+                                                sz * wx[c & 1] * wy[(c >> 1) & 1]);
+            }
+            if (densities)
+                densities[begin + i] = density * invVolume;
+            if (densityGradients)
+                densityGradients[begin + i] = gradient * (invVolume / voxelSize);
+        }
+    }
+}
+
+size_t VoxelGrid::numOccupied() const
+{
+    size_t count = 0;
+    for (const VoxelTable& shard : shards)
+        count += shard.size();
+    return count;
+}
@@ -1,34 +1,125 @@
 #pragma once
 
 #include <Eigen/Dense>
-#include <unordered_map>
-#include <memory>
-#include <mutex>
+#include <array>
+#include <cstdint>
+#include <vector>
 
-// Used in spatial hashing
-static constexpr size_t prime1 = 73856093;
-static constexpr size_t prime2 = 19349663;
-static constexpr size_t prime3 = 83492791;
+// Open addressing hash table from packed integer voxel keys to voxel data.
+// Entries are stored densely in insertion order, so memory follows the number
+// of occupied voxels rather than the extent of the domain. Each entry holds
+// `corners` consecutive masses and velocities: one for a voxel vertex, or the
+// 8 corners of a voxel cell so they can be read with fixed strides.
+class VoxelTable
+{
+public:
+    // Allocates room for capacity entries up front
+    explicit VoxelTable(size_t capacity = 512, int corners = 1);
+
+    // Entry index of key, appending a zeroed entry if it is missing
+    int insert(uint64_t key);
+    // Entry index of key, -1 if it is missing
+    int find(uint64_t key) const;
+    // Removes every entry, resetting only the slots they occupied
+    void clear();
+    size_t size() const { return keys.size(); }
+
+    // Mixes all bits of a key (murmur3 finalizer). Linear probing uses the low
+    // bits, VoxelGrid picks shards from the top bits.
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+
+public:
+    std::vector<uint64_t> keys;
+    // Density of each voxel vertex, based on the hair vertices around it
+    std::vector<float> voxelMasses;
+    // Mass-weighted velocity sum around each voxel vertex, or the average once resolved
+    std::vector<Eigen::Vector3f> voxelVelocities;
+
+private:
+    void rehash(size_t capacity);
 
+    int corners = 1;
+    // Entry index + 1 of each slot, 0 when empty. Kept at most half full.
+    std::vector<int> slots;
+    // Slot of each entry, so clear() costs as much as the inserts did
+    std::vector<int> entrySlots;
+};
+
+// Sparse voxel grid for velocity smoothing and volume preservation, voxel vertices
+// are only stored where hair was splatted and the domain has no fixed extent
 class VoxelGrid
 {
 public:
-    VoxelGrid();
+    // Splatting is split into this many chunks, each accumulating into its own
+    // buffers that are summed in chunk order. The count is fixed rather than per
+    // thread, so the result does not depend on core count or scheduling.
+    static constexpr int splatChunks = 16;
+
+    // Allocates every table for about reservedVoxels occupied voxel vertices, tables
+    // still grow past that but keep their memory from then on
+    explicit VoxelGrid(size_t reservedVoxels = 1 << 16);
+    // Clears the voxels splatted in the last step
     void initVoxelGrid();
-    void getVoxelCoordinates(const Eigen::Vector3f& position,Eigen::Vector3f& firstVoxelCoord,Eigen::Vector3f& localPosition);
-    void sampleVoxelVelocity(Eigen::Vector3f& vertexVel,const Eigen::Vector3f& index);
-    size_t getSpatialHash(Eigen::Vector3f pos);
+    void getVoxelCoordinates(const Eigen::Vector3f& position,Eigen::Vector3i& firstVoxelCoord,Eigen::Vector3f& localPosition) const;
+    void sampleVoxelVelocity(Eigen::Vector3f& vertexVel,const Eigen::Vector3i& index) const;
+    // Packs integer voxel coordinates into a key, 21 bits per axis. Neighbouring
+    // voxels are a fixed stride apart, see cornerStride().
+    static uint64_t getVoxelKey(const Eigen::Vector3i& index);
+    // Key offset from a voxel to its corner c = i + 2j + 4k, (i, j, k) in {0, 1}
+    static uint64_t cornerStride(int c);
+    // Splats the mass and velocity of a vertex into the 8 surrounding voxel corners
+    // of the given chunk's buffers. Chunks can be splatted concurrently without locks.
+    void splat(int chunk, const Eigen::Vector3f& position, const Eigen::Vector3f& velocity);
+    // Sums the chunk buffers into the grid, in parallel over shards, then resolves
+    // the averaged corner velocities of every splatted cell for gathering
+    void reduceSplats();
+    // First of the items [0, count) that chunk splats, chunk + 1 gives its end
+    static size_t chunkBegin(int chunk, size_t count) { return count * chunk / splatChunks; }
+    // Trilinearly interpolates the averaged voxel velocity at position
+    Eigen::Vector3f sampleVelocity(const Eigen::Vector3f& position) const;
+    // sampleVelocity() for count positions. Cells are looked up once per position,
+    // the interpolation then runs branch-free over blocks of positions. Optionally
+    // also interpolates the hair density, mass per unit volume, and its gradient from
+    // the same corners.
+    void sampleVelocities(const Eigen::Vector3f* positions, size_t count, Eigen::Vector3f* velocities,
+                          float* densities = nullptr, Eigen::Vector3f* densityGradients = nullptr) const;
+    // Number of voxel vertices holding hair mass
+    size_t numOccupied() const;
 
 public:
-    std::shared_ptr<std::mutex> voxelMutex;
-    // Stores the density of each voxel vertex, which is based on the number of hair vertices that are in the voxel
-    std::vector<float> voxelMasses;
-    // Stores the average velocity around the voxel vertex
-    std::vector<Eigen::Vector3f> voxelVelocities;   
+    // Side length of each voxel. Voxel coordinates must stay within 2^20 of the origin.
+    float voxelSize = 1.0f;
 
-     // Side length of cube that makes up the voxel grid
-    float voxelGridExtent = 8.0f;
-    // Side length of each voxel
-    float voxelSize = 1.0f;     
-};
+private:
+    // Mass and momentum a chunk adds to one voxel vertex
+    struct Contribution
+    {
+        uint64_t key;
+        float mass;
+        Eigen::Vector3f velocity;
+    };
+
+    // Mass and averaged velocity of one voxel vertex, zero if nothing was splatted there
+    void sampleVoxel(const Eigen::Vector3i& index, float& mass, Eigen::Vector3f& velocity) const;
+    static int shardOf(uint64_t key) { return (int)(VoxelTable::hash(key) >> 60) % splatChunks; }
+    // Trilinear weights of the 8 corners, indexed like cornerStride()
+    static void cornerWeights(const Eigen::Vector3f& localPosition, float* weights);
 
+    // Per-chunk splat buffers, keyed by the cell containing each vertex
+    std::array<VoxelTable, splatChunks> chunkTables;
+    // Chunk contributions to voxel vertices and cells, bucketed by destination shard
+    std::vector<std::vector<Contribution>> contributions;
+    std::vector<std::vector<uint64_t>> cellKeys;
+    // Reduced grid, voxel vertices are spread over shards by key so shards merge independently
+    std::array<VoxelTable, splatChunks> shards;
+    // Splatted cells with the mass and averaged velocity of their 8 corners
+    std::array<VoxelTable, splatChunks> cellShards;
+};